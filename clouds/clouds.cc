@@ -39,6 +39,8 @@
 using namespace clouds;
 using namespace stmlib;
 
+const int32_t kSampleRate = 32000;
+
 GranularProcessor processor;
 Codec codec;
 DebugPort debug_port;
@@ -105,14 +107,15 @@ void Init() {
   processor.Init(
       block_mem, sizeof(block_mem),
       block_ccm, sizeof(block_ccm));
+  processor.set_sample_rate(kSampleRate);
 
   settings.Init();
   cv_scaler.Init(settings.mutable_calibration_data());
-  meter.Init(32000);
+  meter.Init(kSampleRate);
   ui.Init(&settings, &cv_scaler, &processor, &meter);
 
   bool master = !version.revised();
-  if (!codec.Init(master, 32000)) {
+  if (!codec.Init(master, kSampleRate)) {
     ui.Panic();
   }
   if (!codec.Start(32, &FillBuffer)) {
@@ -30,6 +30,7 @@
 #define CLOUDS_DSP_AUDIO_BUFFER_H_
 
 #include <algorithm>
+#include <cmath>
 
 #include "stmlib/stmlib.h"
 
@@ -37,12 +38,49 @@
 #include "stmlib/utils/dsp.h"
 
 #include "clouds/dsp/mu_law.h"
+#include "clouds/dsp/sample_conversion.h"
 
 const int32_t kCrossFadeSize = 256;
 const int32_t kInterpolationTail = 8;
+const int32_t kMaxMipmapLevels = 2;
+const int32_t kSummaryBlockSizeBits = 8;
+const int32_t kSummaryBlockSize = 1 << kSummaryBlockSizeBits;
 
 namespace clouds {
 
+// Playback position within the buffer, with 16 bits of fractional part (12
+// bits for the looper). On the module, 32 bits are enough for the 64k buffers;
+// host builds defining CLOUDS_LONG_BUFFER can use buffers holding minutes of
+// audio, and long grains played at high pitch, without overflowing.
+//
+// The looper and WSOLA players smooth their delays and loop points in
+// floating point, counted in samples. A float stops being accurate to the
+// sample beyond 2^24 samples, so they use doubles with long buffers.
+//
+// The cumulative energy of the block summaries wraps around, and differences
+// between two entries stay exact as long as the range they span is shorter
+// than 2^32 / 16384 = 262144 full-scale samples. The buffers of the module are
+// shorter than that. Long buffers use 64 bits.
+#ifdef CLOUDS_LONG_BUFFER
+typedef int64_t PlaybackPhase;
+typedef double PlaybackPosition;
+typedef uint64_t SummaryEnergy;
+#else
+typedef int32_t PlaybackPhase;
+typedef float PlaybackPosition;
+typedef uint32_t SummaryEnergy;
+#endif  // CLOUDS_LONG_BUFFER
+
+// Level of a block of kSummaryBlockSize samples of the buffer. The energy
+// written since the buffer was initialized is accumulated in cumulative_energy
+// (1.0 = 16384 full-scale samples), so that the energy of any range of blocks
+// is the difference between two entries.
+struct BlockSummary {
+  SummaryEnergy cumulative_energy;
+  uint16_t peak;
+  uint16_t rms;
+};
+
 enum Resolution {
   RESOLUTION_16_BIT,
   RESOLUTION_8_BIT,
@@ -56,12 +94,27 @@ enum InterpolationMethod {
   INTERPOLATION_HERMITE
 };
 
+// Chooses the decimated copy of the buffer from which playback with the given
+// phase increment (16 bits of fractional part) reads at most one sample in two.
+inline int32_t MipmapLevel(int32_t phase_increment, int32_t num_mipmaps) {
+  if (phase_increment < 0) {
+    phase_increment = -phase_increment;
+  }
+  int32_t level = 0;
+  while (level < num_mipmaps && phase_increment >= (131072 << level)) {
+    ++level;
+  }
+  return level;
+}
+
 template<Resolution resolution>
 class AudioBuffer {
  public:
   AudioBuffer() { }
   ~AudioBuffer() { }
   
+  // The memory is not cleared here: ClearSome() must be called until it
+  // returns true before anything is recorded or played.
   void Init(
       void* buffer,
       int32_t size,
@@ -72,20 +125,71 @@ class AudioBuffer {
     write_head_ = 0;
     quantization_error_ = 0.0f;
     crossfade_counter_ = 0;
+    mipmap_ = NULL;
+    decimation_history_[0] = decimation_history_[1] = 0.0f;
+    summary_ = NULL;
+    num_cleared_ = 0;
+    tail_ = tail_buffer;
+  }
+  
+  // Fills up to num_samples more samples of this buffer, then of its mipmaps,
+  // with silence. Returns true once everything is clear.
+  bool ClearSome(int32_t num_samples) {
+    int32_t end = std::min(
+        num_cleared_ + num_samples,
+        size_ + kInterpolationTail);
     if (resolution == RESOLUTION_16_BIT) {
-      std::fill(&s16_[0], &s16_[size], 0);
+      std::fill(&s16_[num_cleared_], &s16_[end], 0);
     } else {
       std::fill(
-          &s8_[0],
-          &s8_[size],
+          &s8_[num_cleared_],
+          &s8_[end],
           resolution == RESOLUTION_8_BIT_MU_LAW ? 127 : 0);
     }
-    tail_ = tail_buffer;
+    num_samples -= end - num_cleared_;
+    num_cleared_ = end;
+    if (num_cleared_ != size_ + kInterpolationTail) {
+      return false;
+    }
+    return mipmap_ ? mipmap_->ClearSome(num_samples) : true;
+  }
+  
+  // Attaches a buffer, already initialized with half the size of this one,
+  // which will receive a decimated copy of everything written here. Mipmaps
+  // can be chained to provide 1/4, 1/8... rate copies. The size of this buffer
+  // must be a multiple of 2.
+  void AttachMipmap(AudioBuffer* mipmap) {
+    mipmap_ = mipmap;
+    mipmap_->write_head_ = write_head_ >> 1;
+    decimation_history_[0] = decimation_history_[1] = 0.0f;
+  }
+  
+  // Attaches an array of num_summary_blocks() entries in which the peak and RMS
+  // levels of the recorded audio will be tracked.
+  void AttachSummary(BlockSummary* summary) {
+    summary_ = summary;
+    if (summary_) {
+      std::fill(
+          &summary_[0],
+          &summary_[num_summary_blocks()],
+          BlockSummary());
+      summary_total_ = 0;
+      summary_peak_ = summary_energy_ = 0.0f;
+    }
   }
   
   inline void Resync(int32_t head) {
     write_head_ = head;
     crossfade_counter_ = 0;
+    if (summary_) {
+      RebuildSummary();
+    }
+    if (mipmap_) {
+      // The content of the buffer has been replaced, the decimated copies
+      // need to be rebuilt.
+      RebuildMipmap();
+      mipmap_->Resync(head >> 1);
+    }
   }
   
   inline void Write(float in) {
@@ -117,6 +221,12 @@ class AudioBuffer {
         s8_[write_head_ + size_] = s8_[write_head_];
       }
     }
+    if (mipmap_) {
+      Decimate(in);
+    }
+    if (summary_) {
+      Summarize(in);
+    }
     ++write_head_;
     if (write_head_ >= size_) {
       write_head_ = 0;
@@ -144,12 +254,8 @@ class AudioBuffer {
         resolution == RESOLUTION_16_BIT &&
         write_head_ >= kInterpolationTail && write_head_ < (size_ - size)) {
       // Fast write routine for the most common case.
-      while (size--) {
-        s16_[write_head_] = stmlib::Clip16(
-            static_cast<int32_t>(*in * 32767.0f));
-        ++write_head_;
-        in += stride;
-      }
+      FloatToShort(in, stride, &s16_[write_head_], size, 32767.0f);
+      Advance(in, size, stride);
     } else {
       while (size--) {
         float sample = *in;
@@ -169,12 +275,8 @@ class AudioBuffer {
     if (resolution == RESOLUTION_16_BIT
         && write_head_ >= kInterpolationTail && write_head_ < (size_ - size)) {
       // Fast write routine for the most common case.
-      while (size--) {
-        s16_[write_head_] = stmlib::Clip16(
-            static_cast<int32_t>(*in * 32768.0f));
-        ++write_head_;
-        in += stride;
-      }
+      FloatToShort(in, stride, &s16_[write_head_], size, 32768.0f);
+      Advance(in, size, stride);
     } else {
       while (size--) {
         Write(*in);
@@ -280,7 +382,227 @@ class AudioBuffer {
   inline int32_t size() const { return size_; }
   inline int32_t head() const { return write_head_; }
   
+  // Copy of the buffer decimated by 2^level. Level 0 is the buffer itself.
+  inline const AudioBuffer* mipmap(int32_t level) const {
+    const AudioBuffer* buffer = this;
+    while (level--) {
+      buffer = buffer->mipmap_;
+    }
+    return buffer;
+  }
+  
+  inline int32_t num_mipmaps() const {
+    return mipmap_ ? mipmap_->num_mipmaps() + 1 : 0;
+  }
+  
+  inline int32_t num_summary_blocks() const {
+    return (size_ + kSummaryBlockSize - 1) >> kSummaryBlockSizeBits;
+  }
+  
+  inline const BlockSummary* summary() const { return summary_; }
+  
+  // Largest peak of the summary blocks overlapping the length samples starting
+  // at start, with the full scale at 65535. The block being recorded counts
+  // with both its new and its not yet overwritten samples. 0 means that the
+  // region holds nothing but digital silence. Returns 65535 when no summary is
+  // attached. The summary blocks are walked one by one, so the cost grows with
+  // length - one step per kSummaryBlockSize samples.
+  inline uint16_t Peak(int32_t start, int32_t length) const {
+    if (!summary_ || length <= 0) {
+      return 65535;
+    }
+    while (start < 0) {
+      start += size_;
+    }
+    while (start >= size_) {
+      start -= size_;
+    }
+    int32_t num_blocks = num_summary_blocks();
+    int32_t head_block = write_head_ >> kSummaryBlockSizeBits;
+    int32_t block = start >> kSummaryBlockSizeBits;
+    int32_t count = ((start & (kSummaryBlockSize - 1)) + length +
+        kSummaryBlockSize - 1) >> kSummaryBlockSizeBits;
+    if (start + length > size_) {
+      // The last block of the buffer is shorter.
+      ++count;
+    }
+    count = std::min(count, num_blocks);
+    uint16_t peak = 0;
+    while (count--) {
+      peak = std::max(peak, summary_[block].peak);
+      if (block == head_block) {
+        peak = std::max(
+            peak,
+            static_cast<uint16_t>(summary_peak_ * 65535.0f));
+      }
+      block = block == num_blocks - 1 ? 0 : block + 1;
+    }
+    return peak;
+  }
+  
+  // RMS level of the length samples starting at start, with the resolution of
+  // a summary block. Returns 1.0 when no summary is attached or when the level
+  // is not known.
+  inline float Loudness(int32_t start, int32_t length) const {
+    if (!summary_ || length <= 0) {
+      return 1.0f;
+    }
+    
+    // Locate the region relative to the write head. Samples which have not
+    // been recorded yet are not taken into account.
+    int32_t age = write_head_ - start;
+    while (age <= 0) {
+      age += size_;
+    }
+    while (age > size_) {
+      age -= size_;
+    }
+    if (length > age) {
+      length = age;
+    }
+    start = write_head_ - age;
+    if (start < 0) {
+      start += size_;
+    }
+    int32_t end = start + length - 1;
+    if (end >= size_) {
+      end -= size_;
+    }
+
+    int32_t num_blocks = num_summary_blocks();
+    int32_t head_block = write_head_ >> kSummaryBlockSizeBits;
+    int32_t first = start >> kSummaryBlockSizeBits;
+    int32_t last = end >> kSummaryBlockSizeBits;
+    if (first == head_block) {
+      if (start < write_head_) {
+        // The region lies in the block being recorded.
+        int32_t count = write_head_ & (kSummaryBlockSize - 1);
+        return count
+            ? sqrtf(summary_energy_ / static_cast<float>(count))
+            : 0.0f;
+      } else if (last == head_block) {
+        return 1.0f;
+      }
+      // Skip the oldest samples, which are about to be overwritten.
+      first = first == num_blocks - 1 ? 0 : first + 1;
+    }
+    if (last == head_block && end < write_head_) {
+      last = last == 0 ? num_blocks - 1 : last - 1;
+    }
+    int32_t previous = first == 0 ? num_blocks - 1 : first - 1;
+    int32_t count = last - first + 1;
+    if (count <= 0) {
+      count += num_blocks;
+    }
+    count <<= kSummaryBlockSizeBits;
+    if (last < first || last == num_blocks - 1) {
+      // The last block of the buffer is shorter.
+      count -= (num_blocks << kSummaryBlockSizeBits) - size_;
+    }
+    SummaryEnergy energy = summary_[last].cumulative_energy -
+        summary_[previous].cumulative_energy;
+    return sqrtf(static_cast<float>(energy) /
+        (16384.0f * static_cast<float>(count)));
+  }
+  
  private:
+  // Every two samples, the mipmap receives one sample filtered with a
+  // [1/4 1/2 1/4] kernel centered on the even sample.
+  inline void Decimate(float in) {
+    if (write_head_ & 1) {
+      mipmap_->Write(
+          0.5f * decimation_history_[0] +
+          0.25f * (decimation_history_[1] + in));
+    }
+    decimation_history_[1] = decimation_history_[0];
+    decimation_history_[0] = in;
+  }
+  
+  // Moves the write head past samples written by the fast write routines,
+  // updating the decimated copies and the summary.
+  inline void Advance(const float* in, int32_t size, int32_t stride) {
+    if (!mipmap_ && !summary_) {
+      write_head_ += size;
+      return;
+    }
+    while (size--) {
+      if (mipmap_) {
+        Decimate(*in);
+      }
+      if (summary_) {
+        Summarize(*in);
+      }
+      ++write_head_;
+      in += stride;
+    }
+  }
+  
+  inline void Summarize(float in) {
+    float magnitude = in > 0.0f ? in : -in;
+    if (magnitude > 1.0f) {
+      magnitude = 1.0f;
+    }
+    if (magnitude > summary_peak_) {
+      summary_peak_ = magnitude;
+    }
+    summary_energy_ += magnitude * magnitude;
+    int32_t next = write_head_ + 1;
+    if (!(next & (kSummaryBlockSize - 1)) || next == size_) {
+      CommitSummary(write_head_ >> kSummaryBlockSizeBits);
+    }
+  }
+  
+  void CommitSummary(int32_t block) {
+    int32_t count = std::min(
+        kSummaryBlockSize,
+        size_ - (block << kSummaryBlockSizeBits));
+    summary_total_ += static_cast<SummaryEnergy>(summary_energy_ * 16384.0f);
+    summary_[block].cumulative_energy = summary_total_;
+    summary_[block].peak = static_cast<uint16_t>(summary_peak_ * 65535.0f);
+    summary_[block].rms = static_cast<uint16_t>(
+        sqrtf(summary_energy_ / static_cast<float>(count)) * 65535.0f);
+    summary_peak_ = summary_energy_ = 0.0f;
+  }
+  
+  void RebuildSummary() {
+    // Summarize the blocks from the oldest to the most recent, then resume
+    // the summary of the block being recorded.
+    int32_t num_blocks = num_summary_blocks();
+    int32_t block = write_head_ >> kSummaryBlockSizeBits;
+    summary_total_ = 0;
+    summary_peak_ = summary_energy_ = 0.0f;
+    for (int32_t i = 0; i < num_blocks; ++i) {
+      int32_t first = block << kSummaryBlockSizeBits;
+      int32_t last = std::min(first + kSummaryBlockSize, size_);
+      for (int32_t j = first; j < last; ++j) {
+        float magnitude = fabs(ReadZOH(j, 0));
+        summary_peak_ = std::max(summary_peak_, magnitude);
+        summary_energy_ += magnitude * magnitude;
+      }
+      CommitSummary(block);
+      block = block == num_blocks - 1 ? 0 : block + 1;
+    }
+    for (int32_t j = block << kSummaryBlockSizeBits; j < write_head_; ++j) {
+      float magnitude = fabs(ReadZOH(j, 0));
+      summary_peak_ = std::max(summary_peak_, magnitude);
+      summary_energy_ += magnitude * magnitude;
+    }
+  }
+  
+  void RebuildMipmap() {
+    mipmap_->write_head_ = 0;
+    float previous = ReadZOH(size_ - 1, 0);
+    for (int32_t i = 0; i < size_; i += 2) {
+      float current = ReadZOH(i, 0);
+      float next = ReadZOH(i + 1, 0);
+      mipmap_->Write(0.5f * current + 0.25f * (previous + next));
+      previous = next;
+    }
+    decimation_history_[0] = ReadZOH(write_head_ + size_ - 1, 0);
+    decimation_history_[1] = ReadZOH(write_head_ + size_ - 2, 0);
+  }
+  
+
   int16_t* s16_;
   int8_t* s8_;
   
@@ -289,11 +611,20 @@ class AudioBuffer {
   int16_t tail_ptr_;
 
   int32_t size_;
+  int32_t num_cleared_;
   int32_t write_head_;
   
   int16_t* tail_;
   int32_t crossfade_counter_;
   
+  AudioBuffer* mipmap_;
+  float decimation_history_[2];
+  
+  BlockSummary* summary_;
+  SummaryEnergy summary_total_;
+  float summary_peak_;
+  float summary_energy_;
+  
   DISALLOW_COPY_AND_ASSIGN(AudioBuffer);
 };
 
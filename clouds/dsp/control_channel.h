@@ -0,0 +1,150 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Lock-free channels between one control context (UI, main loop, GUI or
+// automation thread) and the audio context: a single-producer/single-consumer
+// queue for commands, and a snapshot buffer publishing a whole structure at
+// once, so that the reader never sees a half-written one.
+
+#ifndef CLOUDS_DSP_CONTROL_CHANNEL_H_
+#define CLOUDS_DSP_CONTROL_CHANNEL_H_
+
+#include "stmlib/stmlib.h"
+
+namespace clouds {
+
+// Push() must only be called by the producer, Pop() by the consumer. The
+// capacity is a power of 2; one slot is kept empty.
+template<typename T, size_t capacity>
+class SpscQueue {
+ public:
+  SpscQueue() { }
+  ~SpscQueue() { }
+  
+  void Init() {
+    read_ptr_ = 0;
+    write_ptr_ = 0;
+  }
+  
+  // Returns false, and drops the item, when the queue is full.
+  inline bool Push(const T& item) {
+    size_t w = __atomic_load_n(&write_ptr_, __ATOMIC_RELAXED);
+    size_t next = (w + 1) & (capacity - 1);
+    if (next == __atomic_load_n(&read_ptr_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    items_[w] = item;
+    __atomic_store_n(&write_ptr_, next, __ATOMIC_RELEASE);
+    return true;
+  }
+  
+  inline bool Pop(T* item) {
+    size_t r = __atomic_load_n(&read_ptr_, __ATOMIC_RELAXED);
+    if (r == __atomic_load_n(&write_ptr_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    *item = items_[r];
+    __atomic_store_n(&read_ptr_, (r + 1) & (capacity - 1), __ATOMIC_RELEASE);
+    return true;
+  }
+  
+  inline bool empty() const {
+    return __atomic_load_n(&read_ptr_, __ATOMIC_ACQUIRE) ==
+        __atomic_load_n(&write_ptr_, __ATOMIC_ACQUIRE);
+  }
+  
+ private:
+  T items_[capacity];
+  size_t read_ptr_;
+  size_t write_ptr_;
+  
+  DISALLOW_COPY_AND_ASSIGN(SpscQueue);
+};
+
+// Triple buffer: the writer edits its own copy and publishes it; the reader
+// fetches the latest published copy. Neither side ever waits for the other.
+// A third slot is what makes this possible with two independent contexts -
+// with only two, the writer would have to wait for the reader to release the
+// copy it is working on.
+template<typename T>
+class SnapshotBuffer {
+ public:
+  SnapshotBuffer() { }
+  ~SnapshotBuffer() { }
+  
+  void Init(const T& initial_value) {
+    for (int32_t i = 0; i < 3; ++i) {
+      slots_[i] = initial_value;
+    }
+    back_ = 0;
+    middle_ = 1;
+    front_ = 2;
+  }
+  
+  // Writer side. The content is kept from one Publish() to the next, so the
+  // writer can update only some fields.
+  inline T* mutable_back() {
+    return &slots_[back_];
+  }
+  
+  inline void Publish() {
+    int32_t published = back_;
+    back_ = __atomic_exchange_n(
+        &middle_, published | kFresh, __ATOMIC_ACQ_REL) & kIndex;
+    slots_[back_] = slots_[published];
+  }
+  
+  // Reader side. Returns true, and makes front() the latest published value,
+  // if something has been published since the last call.
+  inline bool Fetch() {
+    if (!(__atomic_load_n(&middle_, __ATOMIC_RELAXED) & kFresh)) {
+      return false;
+    }
+    front_ = __atomic_exchange_n(&middle_, front_, __ATOMIC_ACQ_REL) & kIndex;
+    return true;
+  }
+  
+  inline const T& front() const {
+    return slots_[front_];
+  }
+  
+ private:
+  enum {
+    kIndex = 3,
+    kFresh = 4
+  };
+  
+  T slots_[3];
+  int32_t back_;
+  int32_t middle_;
+  int32_t front_;
+  
+  DISALLOW_COPY_AND_ASSIGN(SnapshotBuffer);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_CONTROL_CHANNEL_H_
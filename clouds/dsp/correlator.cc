@@ -30,45 +30,148 @@
 
 #include <algorithm>
 
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+  #define CLOUDS_CORRELATOR_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define CLOUDS_CORRELATOR_NEON
+#endif
+
 namespace clouds {
 
 using namespace std;
 
+static inline uint32_t CountBits(uint32_t x) {
+#if defined(__POPCNT__) || defined(__aarch64__)
+  return __builtin_popcount(x);
+#else
+  x = x - ((x >> 1) & 0x55555555);
+  x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+  return (((x + (x >> 4)) & 0xf0f0f0f) * 0x1010101) >> 24;
+#endif  // __POPCNT__ || __aarch64__
+}
+
+// The 32 bits starting shift bits into high, followed by the bits of low. A
+// shift of 0 selects high - without shifting low by 32, which is undefined.
+static inline uint32_t Splice(uint32_t high, uint32_t low, int32_t shift) {
+  return (high << shift) | (low >> 1 >> (31 - shift));
+}
+
+#ifdef CLOUDS_CORRELATOR_SSE2
+
+// Number of set bits in each byte.
+static inline __m128i CountBitsPerByte(__m128i x) {
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0f);
+  x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi64(x, 1), m1));
+  x = _mm_add_epi8(
+      _mm_and_si128(x, m2),
+      _mm_and_si128(_mm_srli_epi64(x, 2), m2));
+  return _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi64(x, 4)), m4);
+}
+
+#endif  // CLOUDS_CORRELATOR_SSE2
+
 void Correlator::Init(uint32_t* source, uint32_t* destination) {
   source_ = source;
   destination_ = destination;
   offset_ = 0;
+  increment_ = 0;
+  size_ = 0;
+  candidate_ = 0;
+  best_score_ = 0;
   best_match_ = 0;
   done_ = true;
 }
 
-void Correlator::EvaluateNextCandidate() {
+void Correlator::EvaluateNextCandidates() {
   if (done_) {
     return;
   }
-  uint32_t num_words = size_ >> 5;
-  uint32_t offset_words = candidate_ >> 5;
-  uint32_t offset_bits = candidate_ & 0x1f;
-  uint32_t* source = &source_[0];
-  uint32_t* destination = &destination_[offset_words];
+  // Candidates are evaluated from a multiple of kCorrelatorCandidatesPerPass,
+  // so the destination words of all of them start at the same offset.
+  int32_t num_words = size_ >> 5;
+  int32_t offset_bits = candidate_ & 0x1f;
+  const uint32_t* source = &source_[0];
+  const uint32_t* destination = &destination_[candidate_ >> 5];
   
-  uint32_t xcorr = 0;
-  for (uint32_t i = 0; i < num_words; ++i) {
+  // Count the mismatching bits.
+  uint32_t errors[kCorrelatorCandidatesPerPass];
+  fill(&errors[0], &errors[kCorrelatorCandidatesPerPass], 0);
+  int32_t i = 0;
+#if defined(CLOUDS_CORRELATOR_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums[kCorrelatorCandidatesPerPass];
+  for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+    sums[j] = zero;
+  }
+  for (; i + 4 <= num_words; i += 4) {
+    __m128i source_bits = _mm_loadu_si128((const __m128i*)(source + i));
+    __m128i high = _mm_loadu_si128((const __m128i*)(destination + i));
+    __m128i low = _mm_loadu_si128((const __m128i*)(destination + i + 1));
+    for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+      int32_t shift = offset_bits + j;
+      // Shifting by 32 clears the lanes, as it should for a shift of 0.
+      __m128i destination_bits = _mm_or_si128(
+          _mm_sll_epi32(high, _mm_cvtsi32_si128(shift)),
+          _mm_srl_epi32(low, _mm_cvtsi32_si128(32 - shift)));
+      __m128i count = CountBitsPerByte(
+          _mm_xor_si128(source_bits, destination_bits));
+      sums[j] = _mm_add_epi64(sums[j], _mm_sad_epu8(count, zero));
+    }
+  }
+  for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+    errors[j] = _mm_cvtsi128_si32(sums[j]) + \
+        _mm_cvtsi128_si32(_mm_unpackhi_epi64(sums[j], sums[j]));
+  }
+#elif defined(CLOUDS_CORRELATOR_NEON)
+  uint32x4_t sums[kCorrelatorCandidatesPerPass];
+  for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+    sums[j] = vdupq_n_u32(0);
+  }
+  for (; i + 4 <= num_words; i += 4) {
+    uint32x4_t source_bits = vld1q_u32(source + i);
+    uint32x4_t high = vld1q_u32(destination + i);
+    uint32x4_t low = vld1q_u32(destination + i + 1);
+    for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+      int32_t shift = offset_bits + j;
+      // Shifting by -32 clears the lanes, as it should for a shift of 0.
+      uint32x4_t destination_bits = vorrq_u32(
+          vshlq_u32(high, vdupq_n_s32(shift)),
+          vshlq_u32(low, vdupq_n_s32(shift - 32)));
+      uint8x16_t count = vcntq_u8(
+          vreinterpretq_u8_u32(veorq_u32(source_bits, destination_bits)));
+      sums[j] = vpadalq_u16(sums[j], vpaddlq_u8(count));
+    }
+  }
+  for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+    errors[j] = vgetq_lane_u32(sums[j], 0) + vgetq_lane_u32(sums[j], 1) + \
+        vgetq_lane_u32(sums[j], 2) + vgetq_lane_u32(sums[j], 3);
+  }
+#endif  // CLOUDS_CORRELATOR_SSE2
+  for (; i < num_words; ++i) {
     uint32_t source_bits = source[i];
-    uint32_t destination_bits = 0;
-    destination_bits |= destination[i] << offset_bits;
-    destination_bits |= destination[i + 1] >> (32 - offset_bits);
-    uint32_t count = ~(source_bits ^ destination_bits);
-    count = count - ((count >> 1) & 0x55555555);
-    count = (count & 0x33333333) + ((count >> 2) & 0x33333333);
-    count = (((count + (count >> 4)) & 0xf0f0f0f) * 0x1010101) >> 24;
-    xcorr += count;
+    uint32_t high = destination[i];
+    uint32_t low = destination[i + 1];
+    for (int32_t j = 0; j < kCorrelatorCandidatesPerPass; ++j) {
+      errors[j] += CountBits(
+          source_bits ^ Splice(high, low, offset_bits + j));
+    }
   }
-  if (xcorr > best_score_) {
-    best_match_ = candidate_;
-    best_score_ = xcorr;
+  
+  int32_t num_candidates = min(
+      kCorrelatorCandidatesPerPass,
+      size_ - candidate_);
+  for (int32_t j = 0; j < num_candidates; ++j) {
+    uint32_t xcorr = (num_words << 5) - errors[j];
+    if (xcorr > best_score_) {
+      best_match_ = candidate_ + j;
+      best_score_ = xcorr;
+    }
   }
-  ++candidate_;
+  candidate_ += kCorrelatorCandidatesPerPass;
   done_ = candidate_ >= size_;
 }
 
@@ -27,6 +27,11 @@
 // Search for stretch/shift splicing points by maximizing correlation.
 // Correlation is computed by XOR-ing the bit sign of samples - this allows
 // 32 samples to be matched in one single XOR operation.
+//
+// Neighbouring candidates are evaluated in the same pass, so that the source
+// and destination words are read once for all of them. With SSE2 or NEON,
+// 4 words are matched at a time, and their bits counted in the lanes of a
+// vector.
 
 #ifndef CLOUDS_DSP_CORRELATOR_H_
 #define CLOUDS_DSP_CORRELATOR_H_
@@ -34,6 +39,8 @@
 #include "stmlib/stmlib.h"
 
 namespace clouds {
+
+const int32_t kCorrelatorCandidatesPerPass = 4;
   
 class Correlator {
  public:
@@ -45,18 +52,25 @@ class Correlator {
   void StartSearch(int32_t size, int32_t offset, int32_t increment);
   
   inline int32_t best_match() const {
+#ifdef CLOUDS_LONG_BUFFER
+    return offset_ + static_cast<int32_t>(
+        static_cast<int64_t>(best_match_) * increment_ >> 16);
+#else
     return offset_ + (best_match_ * (increment_ >> 4) >> 12);
+#endif  // CLOUDS_LONG_BUFFER
   }
 
   inline void EvaluateSomeCandidates() {
-    size_t num_candidates = (size_ >> 2) + 16;
-    while (num_candidates) {
-      EvaluateNextCandidate();
-      --num_candidates;
+    size_t num_passes = ((size_ >> 2) + 16 + kCorrelatorCandidatesPerPass - 1) /
+        kCorrelatorCandidatesPerPass;
+    while (num_passes) {
+      EvaluateNextCandidates();
+      --num_passes;
     }
   }
 
-  void EvaluateNextCandidate();
+  // Evaluates the next kCorrelatorCandidatesPerPass candidates.
+  void EvaluateNextCandidates();
 
   inline uint32_t* source() { return source_; }
   inline uint32_t* destination() { return destination_; }
@@ -36,9 +36,37 @@ namespace clouds {
 const int32_t kMaxNumChannels = 2;
 const size_t kMaxBlockSize = 32;
 
+// Sample rate for which the engine's constants were tuned.
+const float kNominalSampleRate = 32000.0f;
+
 typedef struct { short l; short r; } ShortFrame;
 typedef struct { float l; float r; } FloatFrame;
 
+// Conversions between interleaved frames and separate channel buffers.
+inline void Deinterleave(
+    const FloatFrame* in,
+    float* l,
+    float* r,
+    size_t size) {
+  while (size--) {
+    *l++ = in->l;
+    *r++ = in->r;
+    ++in;
+  }
+}
+
+inline void Interleave(
+    const float* l,
+    const float* r,
+    FloatFrame* out,
+    size_t size) {
+  while (size--) {
+    out->l = *l++;
+    out->r = *r++;
+    ++out;
+  }
+}
+
 }  // namespace clouds
 
 #endif  // CLOUDS_DSP_FRAME_H_
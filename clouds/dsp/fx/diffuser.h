@@ -40,11 +40,27 @@ class Diffuser {
   Diffuser() { }
   ~Diffuser() { }
   
-  void Init(float* buffer) {
-    engine_.Init(buffer);
+  // The delay lines are stretched by delay_scale.
+  void Init(float* buffer, float delay_scale) {
+    engine_.Init(buffer, delay_scale);
+    engine_.Clear();
   }
   
-  void Process(FloatFrame* in_out, size_t size) {
+  static size_t memory_size(float delay_scale) {
+    return E::memory_size(delay_scale);
+  }
+  
+  // The memory must then be cleared again by calls to ClearSome().
+  void Invalidate() {
+    engine_.Invalidate();
+  }
+  
+  // Returns true once the memory is all clear.
+  bool ClearSome(size_t num_samples) {
+    return engine_.ClearSome(num_samples);
+  }
+  
+  void Process(float* left, float* right, size_t size) {
     typedef E::Reserve<126,
       E::Reserve<180,
       E::Reserve<269,
@@ -67,7 +83,7 @@ class Diffuser {
       engine_.Start(&c);
       
       float wet = 0.0f;
-      c.Read(in_out->l);
+      c.Read(*left);
       c.Read(apl1 TAIL, kap);
       c.WriteAllPass(apl1, -kap);
       c.Read(apl2 TAIL, kap);
@@ -77,9 +93,9 @@ class Diffuser {
       c.Read(apl4 TAIL, kap);
       c.WriteAllPass(apl4, -kap);
       c.Write(wet, 0.0f);
-      in_out->l += amount_ * (wet - in_out->l);
+      *left += amount_ * (wet - *left);
       
-      c.Read(in_out->r);
+      c.Read(*right);
       c.Read(apr1 TAIL, kap);
       c.WriteAllPass(apr1, -kap);
       c.Read(apr2 TAIL, kap);
@@ -89,9 +105,10 @@ class Diffuser {
       c.Read(apr4 TAIL, kap);
       c.WriteAllPass(apr4, -kap);
       c.Write(wet, 0.0f);
-      in_out->r += amount_ * (wet - in_out->r);
+      *right += amount_ * (wet - *right);
 
-      ++in_out;
+      ++left;
+      ++right;
     }
   }
   
@@ -30,6 +30,7 @@
 #define CLOUDS_DSP_FX_FX_ENGINE_H_
 
 #include <algorithm>
+#include <cstring>
 
 #include "stmlib/stmlib.h"
 
@@ -104,15 +105,55 @@ class FxEngine {
   FxEngine() { }
   ~FxEngine() { }
 
-  void Init(T* buffer) {
+  // Number of samples of memory needed by delay lines stretched by scale. The
+  // memory is kept a power of two.
+  static size_t memory_size(float scale) {
+    size_t memory_size = size;
+    while (memory_size < size * scale) {
+      memory_size <<= 1;
+    }
+    return memory_size;
+  }
+
+  // The delay lines are laid out as declared, stretched by scale. Offsets
+  // within them are still given in samples. The memory must hold
+  // memory_size(scale) samples.
+  //
+  // The memory is not cleared here: Clear(), or ClearSome() until it returns
+  // true, must be called before anything is processed.
+  void Init(T* buffer, float scale) {
     buffer_ = buffer;
-    Clear();
+    scale_ = scale;
+    size_ = memory_size(scale);
+    // Oliverb never starts the LFOs and relies on them being silent.
+    memset(static_cast<void*>(lfo_), 0, sizeof(lfo_));
+    write_ptr_ = 0;
+    num_cleared_ = 0;
   }
   
   void Clear() {
-    std::fill(&buffer_[0], &buffer_[size], 0);
+    std::fill(&buffer_[0], &buffer_[size_], 0);
     write_ptr_ = 0;
+    num_cleared_ = size_;
   }
+  
+  // Fills up to num_samples more samples of the memory with silence. Returns
+  // true once it is all clear.
+  bool ClearSome(size_t num_samples) {
+    size_t end = std::min(num_cleared_ + num_samples, size_);
+    std::fill(&buffer_[num_cleared_], &buffer_[end], 0);
+    num_cleared_ = end;
+    return num_cleared_ == size_;
+  }
+  
+  // Marks the whole memory as stale. ClearSome() clears it again from the
+  // start, and must be called until it returns true before anything is
+  // processed.
+  void Invalidate() {
+    num_cleared_ = 0;
+  }
+  
+  inline float scale() const { return scale_; }
 
   struct Empty { };
   
@@ -172,9 +213,9 @@ class FxEngine {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       T w = DataType<format>::Compress(accumulator_);
       if (offset == -1) {
-        buffer_[(write_ptr_ + D::base + D::length - 1) & MASK] = w;
+        buffer_[(write_ptr_ + tail(d)) & mask_] = w;
       } else {
-        buffer_[(write_ptr_ + D::base + offset) & MASK] = w;
+        buffer_[(write_ptr_ + base(d) + offset) & mask_] = w;
       }
       accumulator_ *= scale;
     }
@@ -200,9 +241,9 @@ class FxEngine {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       T r;
       if (offset == -1) {
-        r = buffer_[(write_ptr_ + D::base + D::length - 1) & MASK];
+        r = buffer_[(write_ptr_ + tail(d)) & mask_];
       } else {
-        r = buffer_[(write_ptr_ + D::base + offset) & MASK];
+        r = buffer_[(write_ptr_ + base(d) + offset) & mask_];
       }
       float r_f = DataType<format>::Decompress(r);
       previous_read_ = r_f;
@@ -233,9 +274,9 @@ class FxEngine {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       MAKE_INTEGRAL_FRACTIONAL(offset);
       float a = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base(d)) & mask_]);
       float b = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base(d) + 1) & mask_]);
       float x = a + (b - a) * offset_fractional;
       previous_read_ = x;
       accumulator_ += x * scale;
@@ -246,13 +287,13 @@ class FxEngine {
       STATIC_ASSERT(D::base + D::length <= size, delay_memory_full);
       MAKE_INTEGRAL_FRACTIONAL(offset);
       float xm1 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base - 1) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) - 1) & mask_]);
       float x0 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base + 0) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) + 0) & mask_]);
       float x1 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) + 1) & mask_]);
       float x2 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base + 2) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) + 2) & mask_]);
 
       float c = (x1 - xm1) * 0.5f;
       float v = x0 - x1;
@@ -272,9 +313,9 @@ class FxEngine {
       offset += amplitude * lfo_value_[index];
       MAKE_INTEGRAL_FRACTIONAL(offset);
       float a = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base(d)) & mask_]);
       float b = DataType<format>::Decompress(
-          buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+          buffer_[(write_ptr_ + offset_integral + base(d) + 1) & mask_]);
       float x = a + (b - a) * offset_fractional;
       previous_read_ = x;
       accumulator_ += x * scale;
@@ -287,13 +328,13 @@ class FxEngine {
       offset += amplitude * lfo_value_[index];
       MAKE_INTEGRAL_FRACTIONAL(offset);
       float xm1 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base - 1) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) - 1) & mask_]);
       float x0 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base + 0) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) + 0) & mask_]);
       float x1 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base + 1) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) + 1) & mask_]);
       float x2 = DataType<format>::Decompress(
-        buffer_[(write_ptr_ + offset_integral + D::base + 2) & MASK]);
+        buffer_[(write_ptr_ + offset_integral + base(d) + 2) & mask_]);
 
       float c = (x1 - xm1) * 0.5f;
       float v = x0 - x1;
@@ -307,11 +348,23 @@ class FxEngine {
     }
     
    private:
+    template<typename D>
+    inline int32_t base(D& d) const {
+      return static_cast<int32_t>(D::base * scale_);
+    }
+    
+    template<typename D>
+    inline int32_t tail(D& d) const {
+      return base(d) + static_cast<int32_t>(D::length * scale_) - 1;
+    }
+    
     float accumulator_;
     float previous_read_;
     float lfo_value_[2];
     T* buffer_;
     int32_t write_ptr_;
+    int32_t mask_;
+    float scale_;
 
     DISALLOW_COPY_AND_ASSIGN(Context);
   };
@@ -324,12 +377,14 @@ class FxEngine {
   inline void Start(Context* c) {
     --write_ptr_;
     if (write_ptr_ < 0) {
-      write_ptr_ += size;
+      write_ptr_ += size_;
     }
     c->accumulator_ = 0.0f;
     c->previous_read_ = 0.0f;
     c->buffer_ = buffer_;
     c->write_ptr_ = write_ptr_;
+    c->mask_ = size_ - 1;
+    c->scale_ = scale_;
     if ((write_ptr_ & 31) == 0) {
       c->lfo_value_[0] = lfo_[0].Next();
       c->lfo_value_[1] = lfo_[1].Next();
@@ -340,12 +395,11 @@ class FxEngine {
   }
   
  private:
-  enum {
-    MASK = size - 1
-  };
-  
   int32_t write_ptr_;
   T* buffer_;
+  size_t size_;
+  size_t num_cleared_;
+  float scale_;
   stmlib::CosineOscillator lfo_[2];
   
   DISALLOW_COPY_AND_ASSIGN(FxEngine);
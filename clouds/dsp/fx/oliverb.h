@@ -41,23 +41,37 @@ class Oliverb {
   Oliverb() { }
   ~Oliverb() { }
 
-  void Init(uint16_t* buffer) {
-    engine_.Init(buffer);
+  // The delay lines are stretched by delay_scale. The memory is then cleared
+  // by calls to ClearSome().
+  void Init(uint16_t* buffer, float delay_scale, RandomGenerator* random) {
+    engine_.Init(buffer, delay_scale);
     diffusion_ = 0.625f;
     size_ = 1.0f;
     mod_amount_ = 0.0f;
     mod_rate_ = 0.0f;
     size_ = 0.5f;
+    smooth_size_ = 0.0f;
     input_gain_ = 1.0f;
     decay_ = 0.5f;
     lp_ = 1.0f;
     hp_= 0.0f;
+    lp_decay_1_ = lp_decay_2_ = 0.0f;
+    hp_decay_1_ = hp_decay_2_ = 0.0f;
     phase_ = 0.0f;
     ratio_ = 0.0f;
     pitch_shift_amount_ = 1.0f;
     level_ = 0.0f;
     for (int i=0; i<9; i++)
-      lfo_[i].Init();
+      lfo_[i].Init(random);
+  }
+
+  // Returns true once the memory is all clear.
+  bool ClearSome(size_t num_samples) {
+    return engine_.ClearSome(num_samples);
+  }
+  
+  static size_t memory_size(float delay_scale) {
+    return E::memory_size(delay_scale);
   }
 
   void Process(FloatFrame* in_out, size_t size) {
@@ -88,6 +102,8 @@ class Oliverb {
     E::Context c;
 
     const float kap = diffusion_;
+    const float scale = engine_.scale();
+    const int32_t ap1_write = static_cast<int32_t>(100.0f * scale);
 
     float lp_1 = lp_decay_1_;
     float lp_2 = lp_decay_2_;
@@ -108,7 +124,7 @@ class Oliverb {
       ONE_POLE(smooth_size_, size_, 0.01f);
 
       // compute windowing info for the pitch shifter
-      float ps_size = 128.0f + (3410.0f - 128.0f) * smooth_size_;
+      float ps_size = (128.0f + (3410.0f - 128.0f) * smooth_size_) * scale;
       phase_ += (1.0f - ratio_) / ps_size;
       if (phase_ >= 1.0f) phase_ -= 1.0f;
       if (phase_ <= 0.0f) phase_ += 1.0f;
@@ -121,8 +137,9 @@ class Oliverb {
 #define INTERPOLATE_LFO(del, lfo, gain)                                 \
       {                                                                 \
         float offset = (del.length - 1) * smooth_size_;                 \
-        offset += lfo.Next() * mod_amount_;                      \
+        offset += lfo.Next() * mod_amount_;                             \
         CONSTRAIN(offset, 1.0f, del.length - 1);                        \
+        offset *= scale;                                                \
         c.InterpolateHermite(del, offset, gain);                        \
       }
 
@@ -130,12 +147,13 @@ class Oliverb {
       {                                                                 \
         float offset = (del.length - 1) * smooth_size_;                 \
         CONSTRAIN(offset, 1.0f, del.length - 1);                        \
+        offset *= scale;                                                \
         c.InterpolateHermite(del, offset, gain);                        \
       }
 
       // Smear AP1 inside the loop.
-      c.Interpolate(ap1, 10.0f, LFO_1, 60.0f, 1.0f);
-      c.Write(ap1, 100, 0.0f);
+      c.Interpolate(ap1, 10.0f * scale, LFO_1, 60.0f * scale, 1.0f);
+      c.Write(ap1, ap1_write, 0.0f);
 
       c.Read(in_out->l + in_out->r, input_gain_);
       // Diffuse through 4 allpasses.
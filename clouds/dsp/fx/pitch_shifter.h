@@ -43,25 +43,40 @@ class PitchShifter {
   PitchShifter() { }
   ~PitchShifter() { }
   
-  void Init(uint16_t* buffer) {
-    engine_.Init(buffer);
+  // The delay lines, and the window, are stretched by delay_scale.
+  void Init(uint16_t* buffer, float delay_scale) {
+    engine_.Init(buffer, delay_scale);
+    engine_.Clear();
     phase_ = 0;
-    size_ = 2047.0f;
+    size_ = 2047.0f * delay_scale;
     dry_wet_ = 0.0f;
   }
   
+  static size_t memory_size(float delay_scale) {
+    return E::memory_size(delay_scale);
+  }
+  
   void Clear() {
     engine_.Clear();
   }
+  
+  // The memory must then be cleared again by calls to ClearSome().
+  void Invalidate() {
+    engine_.Invalidate();
+  }
+  
+  // Returns true once the memory is all clear.
+  bool ClearSome(size_t num_samples) {
+    return engine_.ClearSome(num_samples);
+  }
 
-  inline void Process(FloatFrame* input_output, size_t size) {
+  inline void Process(float* l, float* r, size_t size) {
     while (size--) {
-      Process(input_output);
-      ++input_output;
+      Process(l++, r++);
     }
   }
   
-  void Process(FloatFrame* input_output) {
+  void Process(float* l, float* r) {
     typedef E::Reserve<2047, E::Reserve<2047> > Memory;
     E::DelayLine<Memory, 0> left;
     E::DelayLine<Memory, 1> right;
@@ -85,21 +100,21 @@ class PitchShifter {
 
     float wet = 0.0f;
 
-    c.Read(input_output->l, 1.0f);
+    c.Read(*l, 1.0f);
     c.Write(left, 0.0f);
     c.InterpolateHermite(left, phase, tri);
     c.InterpolateHermite(left, half, 1.0f - tri);
     c.Write(wet, 0.0f);
 
-    input_output->l += (wet - input_output->l) * dry_wet_;
+    *l += (wet - *l) * dry_wet_;
 
-    c.Read(input_output->r, 1.0f);
+    c.Read(*r, 1.0f);
     c.Write(right, 0.0f);
     c.InterpolateHermite(right, phase, tri);
     c.InterpolateHermite(right, half, 1.0f - tri);
     c.Write(wet, 0.0f);
 
-    input_output->r += (wet - input_output->r) * dry_wet_;
+    *r += (wet - *r) * dry_wet_;
 
   }
   
@@ -113,6 +128,7 @@ class PitchShifter {
   
   inline void set_size(float size) {
     float target_size = 128.0f + (2047.0f - 128.0f) * size * size * size;
+    target_size *= engine_.scale();
     ONE_POLE(size_, target_size, 0.05f)
   }
   
@@ -40,15 +40,35 @@ class Reverb {
   Reverb() { }
   ~Reverb() { }
 
-  void Init(uint16_t* buffer) {
-    engine_.Init(buffer);
-    engine_.SetLFOFrequency(LFO_1, 0.5f / 32000.0f);
-    engine_.SetLFOFrequency(LFO_2, 0.3f / 32000.0f);
+  // The delay lines are stretched by delay_scale. The memory is then cleared
+  // by calls to ClearSome().
+  void Init(uint16_t* buffer, float sample_rate, float delay_scale) {
+    engine_.Init(buffer, delay_scale);
+    engine_.SetLFOFrequency(LFO_1, 0.5f / sample_rate);
+    engine_.SetLFOFrequency(LFO_2, 0.3f / sample_rate);
     lp_ = 0.7f;
     diffusion_ = 0.625f;
+    lp_decay_1_ = 0.0f;
+    lp_decay_2_ = 0.0f;
+  }
+  
+  // The memory must then be cleared again by calls to ClearSome().
+  void Invalidate() {
+    engine_.Invalidate();
+    lp_decay_1_ = 0.0f;
+    lp_decay_2_ = 0.0f;
+  }
+  
+  // Returns true once the memory is all clear.
+  bool ClearSome(size_t num_samples) {
+    return engine_.ClearSome(num_samples);
+  }
+  
+  static size_t memory_size(float delay_scale) {
+    return E::memory_size(delay_scale);
   }
 
-  void Process(FloatFrame* in_out, size_t size) {
+  void Process(float* left, float* right, size_t size) {
     // This is the Griesinger topology described in the Dattorro paper
     // (4 AP diffusers on the input, then a loop of 2x 2AP+1Delay).
     // Modulation is applied in the loop of the first diffuser AP for additional
@@ -80,6 +100,8 @@ class Reverb {
     const float krt = reverb_time_;
     const float amount = amount_;
     const float gain = input_gain_;
+    const float scale = engine_.scale();
+    const int32_t ap1_write = static_cast<int32_t>(100.0f * scale);
 
     float lp_1 = lp_decay_1_;
     float lp_2 = lp_decay_2_;
@@ -90,10 +112,10 @@ class Reverb {
       engine_.Start(&c);
 
       // Smear AP1 inside the loop.
-      c.Interpolate(ap1, 10.0f, LFO_1, 60.0f, 1.0f);
-      c.Write(ap1, 100, 0.0f);
+      c.Interpolate(ap1, 10.0f * scale, LFO_1, 60.0f * scale, 1.0f);
+      c.Write(ap1, ap1_write, 0.0f);
 
-      c.Read(in_out->l + in_out->r, gain);
+      c.Read(*left + *right, gain);
 
       // Diffuse through 4 allpasses.
       c.Read(ap1 TAIL, kap);
@@ -108,7 +130,7 @@ class Reverb {
 
       // Main reverb loop.
       c.Load(apout);
-      c.Interpolate(del2, 4680.0f, LFO_2, 100.0f, krt);
+      c.Interpolate(del2, 4680.0f * scale, LFO_2, 100.0f * scale, krt);
       c.Lp(lp_1, klp);
       c.Read(dap1a TAIL, -kap);
       c.WriteAllPass(dap1a, kap);
@@ -117,7 +139,7 @@ class Reverb {
       c.Write(del1, 2.0f);
       c.Write(wet, 0.0f);
 
-      in_out->l += (wet - in_out->l) * amount;
+      *left += (wet - *left) * amount;
 
       c.Load(apout);
       // c.Interpolate(del1, 4450.0f, LFO_1, 50.0f, krt);
@@ -130,9 +152,10 @@ class Reverb {
       c.Write(del2, 2.0f);
       c.Write(wet, 0.0f);
 
-      in_out->r += (wet - in_out->r) * amount;
+      *right += (wet - *right) * amount;
 
-      ++in_out;
+      ++left;
+      ++right;
     }
 
     lp_decay_1_ = lp_1;
@@ -0,0 +1,130 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Decides when a post-processing stage can be skipped: either because it is
+// disabled, or because both its input and its decaying tail are inaudible.
+
+#ifndef CLOUDS_DSP_FX_TAIL_DETECTOR_H_
+#define CLOUDS_DSP_FX_TAIL_DETECTOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <cmath>
+
+namespace clouds {
+
+const float kTailThreshold = 1.0f / 32768.0f;
+
+// Longer than the longest loop of the reverb, at the nominal sample rate and
+// with unstretched delay lines.
+const int32_t kTailHoldBlocks = 256;
+
+class TailDetector {
+ public:
+  TailDetector() { }
+  ~TailDetector() { }
+  
+  void Init() {
+    running_ = false;
+    stopped_ = false;
+    stale_ = false;
+    quiet_blocks_ = 0;
+    hold_blocks_ = kTailHoldBlocks;
+  }
+  
+  // Stretches the hold along with the delay lines of the stage.
+  void set_hold(float scale) {
+    hold_blocks_ = static_cast<int32_t>(kTailHoldBlocks * scale + 0.999f);
+  }
+  
+  // Returns true if the stage must process this block. When a running stage
+  // is skipped, stopped() is set: the caller then invalidates the content of
+  // its memory, and calls set_stale() if it is to be cleared between blocks.
+  // The stage does not run again until Cleared() is called.
+  bool Begin(bool enabled, const float* l, const float* r, size_t size) {
+    bool run = enabled && !stale() && (
+        quiet_blocks_ < hold_blocks_ || Peak(l, r, size) >= kTailThreshold);
+    stopped_ = running_ && !run;
+    if (run && !running_) {
+      quiet_blocks_ = 0;
+    }
+    running_ = run;
+    return run;
+  }
+  
+  // Measures the output of the stage. Once the input is silent, this is the
+  // level of the tail left in the delay memory: everything it holds reaches
+  // the output taps within one loop, which is shorter than the hold.
+  void End(const float* l, const float* r, size_t size) {
+    if (Peak(l, r, size) >= kTailThreshold) {
+      quiet_blocks_ = 0;
+    } else if (quiet_blocks_ < hold_blocks_) {
+      ++quiet_blocks_;
+    }
+  }
+  
+  // The memory can be cleared in another thread than the one running the
+  // stage - see PipelinedProcessor. The flag is raised once the memory has
+  // been invalidated, and lowered once it has been cleared.
+  inline void set_stale() {
+    __atomic_store_n(&stale_, true, __ATOMIC_RELEASE);
+  }
+  
+  inline void Cleared() {
+    __atomic_store_n(&stale_, false, __ATOMIC_RELEASE);
+  }
+  
+  inline bool stale() const {
+    return __atomic_load_n(&stale_, __ATOMIC_ACQUIRE);
+  }
+  
+  inline bool running() const { return running_; }
+  inline bool stopped() const { return stopped_; }
+  
+ private:
+  static float Peak(const float* l, const float* r, size_t size) {
+    float peak = 0.0f;
+    while (size--) {
+      float a = fabsf(*l++);
+      float b = fabsf(*r++);
+      peak = a > peak ? a : peak;
+      peak = b > peak ? b : peak;
+    }
+    return peak;
+  }
+  
+  bool running_;
+  bool stopped_;
+  bool stale_;
+  int32_t quiet_blocks_;
+  int32_t hold_blocks_;
+  
+  DISALLOW_COPY_AND_ASSIGN(TailDetector);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_FX_TAIL_DETECTOR_H_
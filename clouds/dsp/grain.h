@@ -66,7 +66,10 @@ class Grain {
 
   void Init() {
     active_ = false;
+    muted_ = false;
     envelope_phase_ = 2.0f;
+    mipmap_level_ = 0;
+    recommended_quality_ = GRAIN_QUALITY_LOW;
   }
 
   void Start(
@@ -79,14 +82,19 @@ class Grain {
       float window_shape,
       float gain_l,
       float gain_r,
-      GrainQuality recommended_quality) {
+      GrainQuality recommended_quality,
+      int32_t num_mipmaps) {
     pre_delay_ = pre_delay;
     reverse_ = reverse;
 
-    first_sample_ = (start + buffer_size) % buffer_size;
+    // Grains transposed up by more than an octave are read from a decimated
+    // copy of the buffer.
+    mipmap_level_ = MipmapLevel(phase_increment, num_mipmaps);
+    phase_increment >>= mipmap_level_;
+    first_sample_ = ((start + buffer_size) % buffer_size) >> mipmap_level_;
     if (reverse) {
       phase_increment_ = -phase_increment;
-      phase_ = width * phase_increment;
+      phase_ = static_cast<PlaybackPhase>(width) * phase_increment;
     } else {
       phase_increment_ = phase_increment;
       phase_ = 0;
@@ -101,6 +109,7 @@ class Grain {
     envelope_bias_ = InterpolatePlateau(bias_response, window_shape, 3);
 
     active_ = true;
+    muted_ = false;
     gain_l_ = gain_l;
     gain_r_ = gain_r;
     recommended_quality_ = recommended_quality;
@@ -147,14 +156,22 @@ class Grain {
     
     // Pre-render the envelope in one pass.
     RenderEnvelope(envelope, size);
+    if (muted_) {
+      // Nothing to read, but the grain ends when it would have.
+      active_ = envelope_phase_ < 2.0f;
+      return;
+    }
 
-    const int32_t phase_increment = phase_increment_;
+    const AudioBuffer<resolution>* l_buffer = buffer[0].mipmap(mipmap_level_);
+    const AudioBuffer<resolution>* r_buffer = buffer[
+        num_channels - 1].mipmap(mipmap_level_);
+    const PlaybackPhase phase_increment = phase_increment_;
     const int32_t first_sample = first_sample_;
     const float gain_l = gain_l_;
     const float gain_r = gain_r_;
-    int32_t phase = phase_;
+    PlaybackPhase phase = phase_;
     while (size--) {
-      int32_t sample_index = first_sample + (phase >> 16);
+      int32_t sample_index = first_sample + static_cast<int32_t>(phase >> 16);
 
       float gain = *envelope++;
       if (gain == -1.0f) {
@@ -162,13 +179,13 @@ class Grain {
         break;
       }
 
-      float l = buffer[0].template Read<InterpolationMethod(quality)>(
+      float l = l_buffer->template Read<InterpolationMethod(quality)>(
           sample_index, phase & 65535) * gain;
       if (num_channels == 1) {
         *destination++ += l * gain_l;
         *destination++ += l * gain_r;
       } else if (num_channels == 2) {
-        float r = buffer[1].template Read<InterpolationMethod(quality)>(
+        float r = r_buffer->template Read<InterpolationMethod(quality)>(
             sample_index, phase & 65535) * gain;
         *destination++ += l * gain_l + r * (1.0f - gain_r);
         *destination++ += r * gain_r + l * (1.0f - gain_l);
@@ -180,14 +197,20 @@ class Grain {
   
   inline bool active() { return active_; }
   
+  // The grain keeps its slot and its duration - and thus its share of the
+  // gain normalization - but does not read the buffer. For grains which
+  // would only play digital silence.
+  inline void Mute() { muted_ = true; }
+  
   inline GrainQuality recommended_quality() const {
     return recommended_quality_;
   }
 
  private:
   int32_t first_sample_;
-  int32_t phase_;
-  int32_t phase_increment_;
+  int32_t mipmap_level_;
+  PlaybackPhase phase_;
+  PlaybackPhase phase_increment_;
   int32_t pre_delay_;
 
   float envelope_slope_;
@@ -199,6 +222,7 @@ class Grain {
   float gain_r_;
 
   bool active_;
+  bool muted_;
   bool reverse_;
   
   GrainQuality recommended_quality_;
@@ -28,6 +28,7 @@
 
 #include "clouds/dsp/granular_processor.h"
 
+#include <cassert>
 #include <cstring>
 
 #include "clouds/drivers/debug_pin.h"
@@ -35,6 +36,7 @@
 #include "stmlib/dsp/parameter_interpolator.h"
 #include "stmlib/utils/buffer_allocator.h"
 
+#include "clouds/dsp/sample_conversion.h"
 #include "clouds/resources.h"
 
 namespace clouds {
@@ -51,17 +53,46 @@ void GranularProcessor::Init(
   buffer_size_[1] = small_buffer_size;
   
   num_channels_ = 2;
-  low_fidelity_ = false;
+  num_mipmap_levels_ = 0;
+  downsampling_factor_ = 1;
+  sample_rate_ = kNominalSampleRate;
+  delay_scale_ = 1.0f;
   bypass_ = false;
+  inf_reverb_ = false;
+  silence_ = false;
   
-  src_down_.Init();
-  src_up_.Init();
+  src_filter_ = SRC_FILTER_1X_2_45;
+  InitSampleRateConverters();
   
   ResetFilters();
+  fb_filter_tail_.Init();
+  diffuser_tail_.Init();
+  pitch_shifter_tail_.Init();
+  reverb_tail_.Init();
   
+  playback_mode_ = requested_playback_mode_ = PLAYBACK_MODE_GRANULAR;
   previous_playback_mode_ = PLAYBACK_MODE_LAST;
+  mode_fade_ = 0.0f;
+  reverb_amount_lp_ = 0.0f;
+  random_.Seed(kDefaultRandomSeed);
+  reverb_buffer_ = NULL;
+  init_step_ = INIT_STEP_LAYOUT;
   reset_buffers_ = true;
   dry_wet_ = 0.0f;
+  dry_wet_lp_ = 0.0f;
+  freeze_lp_ = 0.0f;
+  quiet_samples_ = 0;
+  idle_hold_samples_ = kMinIdleHoldSamples;
+  pending_quality_ = -1;
+  
+  memset(&parameters_, 0, sizeof(parameters_));
+  pending_parameters_.Init(parameters_);
+  commands_.Init();
+  block_.Init();
+  queueing_ = false;
+  queue_size_ = 0;
+  fill(&queue_output_[0].l, &queue_output_[0].l + 2 * kMaxBlockSize, 0);
+  num_queued_events_ = 0;
 }
 
 void GranularProcessor::ResetFilters() {
@@ -72,26 +103,63 @@ void GranularProcessor::ResetFilters() {
   }
 }
 
+void GranularProcessor::InitSampleRateConverters() {
+  static const int32_t sizes[] = {
+    SRC_FILTER_1X_2_31_SIZE,
+    SRC_FILTER_1X_2_45_SIZE,
+    SRC_FILTER_1X_2_63_SIZE,
+    SRC_FILTER_1X_2_91_SIZE
+  };
+  const float* coefficients = src_filter_table[src_filter_];
+  int32_t size = sizes[src_filter_];
+  src_down_.Init(coefficients, size);
+  src_up_.Init(coefficients, size);
+  src_down_4_.Init(coefficients, size);
+  src_up_4_.Init(coefficients, size);
+}
+
+/* static */
+bool GranularProcessor::IsSilent(const ShortFrame* frames, size_t size) {
+  const short* samples = &frames[0].l;
+  for (size_t i = 0; i < size * 2; ++i) {
+    int32_t s = samples[i];
+    if (s > kIdleThreshold || s < -kIdleThreshold) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void GranularProcessor::ProcessGranular(
-    FloatFrame* input,
-    FloatFrame* output,
+    const float* input_l,
+    const float* input_r,
+    float* output_l,
+    float* output_r,
     size_t size) {
   // At the exception of the spectral mode, all modes require the incoming
   // audio signal to be written to the recording buffer.
   if (playback_mode_ != PLAYBACK_MODE_SPECTRAL &&
       playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
-    const float* input_samples = &input[0].l;
+    const float* input_samples[2] = { input_l, input_r };
     const bool play = !parameters_.freeze ||
       playback_mode_ == PLAYBACK_MODE_OLIVERB;
     for (int32_t i = 0; i < num_channels_; ++i) {
       if (resolution() == 8) {
-        buffer_8_[i].WriteFade(&input_samples[i], size, 2, play);
+        buffer_8_[i].WriteFade(input_samples[i], size, 1, play);
       } else {
-        buffer_16_[i].WriteFade(&input_samples[i], size, 2, play);
+        buffer_16_[i].WriteFade(input_samples[i], size, 1, play);
       }
     }
   }
   
+  // The playback engines render interleaved frames.
+  FloatFrame* input = engine_in_;
+  FloatFrame* output = engine_out_;
+  if (playback_mode_ == PLAYBACK_MODE_SPECTRAL ||
+      playback_mode_ == PLAYBACK_MODE_RESONESTOR) {
+    Interleave(input_l, input_r, input, size);
+  }
+  
   switch (playback_mode_) {
     case PLAYBACK_MODE_GRANULAR:
       // In Granular mode, DENSITY is a meta parameter.
@@ -177,7 +245,8 @@ void GranularProcessor::ProcessGranular(
           0.0f, // reverb;
           0.0f, // freeze;
           parameters_.trigger, // trigger;
-          0.0f // gate;
+          0.0f, // gate;
+          parameters_.trigger_offset // trigger_offset;
         };
 
         if (resolution() == 8) {
@@ -235,6 +304,7 @@ void GranularProcessor::ProcessGranular(
       resonestor_.set_pitch(parameters_.pitch);
       resonestor_.set_chord(parameters_.size);
       resonestor_.set_trigger(parameters_.trigger);
+      resonestor_.set_trigger_offset(parameters_.trigger_offset);
       resonestor_.set_burst_damp(parameters_.position);
       resonestor_.set_burst_comb((1.0f - parameters_.position));
       resonestor_.set_burst_duration((1.0f - parameters_.position));
@@ -274,86 +344,397 @@ void GranularProcessor::ProcessGranular(
     default:
       break;
   }
+  
+  Deinterleave(output, output_l, output_r, size);
+}
+
+void GranularProcessor::ApplyCommands() {
+  if (pending_parameters_.Fetch()) {
+    parameters_ = pending_parameters_.front();
+  }
+  
+  Command command;
+  while (commands_.Pop(&command)) {
+    switch (command.type) {
+      case COMMAND_TOGGLE_FREEZE:
+        ToggleFreeze();
+        break;
+        
+      case COMMAND_TOGGLE_REVERSE:
+        ToggleReverse();
+        break;
+        
+      case COMMAND_TOGGLE_BYPASS:
+        ToggleBypass();
+        break;
+        
+      case COMMAND_SET_BYPASS:
+        set_bypass(command.argument != 0);
+        break;
+        
+      case COMMAND_SET_INF_REVERB:
+        set_inf_reverb(command.argument != 0);
+        break;
+        
+      case COMMAND_SET_PLAYBACK_MODE:
+        if (command.argument >= 0 && command.argument < PLAYBACK_MODE_LAST) {
+          set_playback_mode(static_cast<PlaybackMode>(command.argument));
+        }
+        break;
+        
+      case COMMAND_SET_QUALITY:
+        if (command.argument >= 0 && command.argument < kNumQualities) {
+          __atomic_store_n(&pending_quality_, command.argument,
+                           __ATOMIC_RELAXED);
+        }
+        break;
+        
+      case COMMAND_SET_SRC_FILTER:
+        set_src_filter(command.argument);
+        break;
+    }
+  }
+}
+
+size_t GranularProcessor::ApplyAutomation(
+    const AutomationEvent* events,
+    size_t num_events,
+    size_t start,
+    size_t size) {
+  size_t n = 0;
+  for (; n < num_events && events[n].offset < start + size; ++n) {
+    const AutomationEvent& e = events[n];
+    switch (e.target) {
+      case AUTOMATION_POSITION: parameters_.position = e.value; break;
+      case AUTOMATION_SIZE: parameters_.size = e.value; break;
+      case AUTOMATION_PITCH: parameters_.pitch = e.value; break;
+      case AUTOMATION_DENSITY: parameters_.density = e.value; break;
+      case AUTOMATION_TEXTURE: parameters_.texture = e.value; break;
+      case AUTOMATION_DRY_WET: parameters_.dry_wet = e.value; break;
+      case AUTOMATION_STEREO_SPREAD: parameters_.stereo_spread = e.value; break;
+      case AUTOMATION_FEEDBACK: parameters_.feedback = e.value; break;
+      case AUTOMATION_REVERB: parameters_.reverb = e.value; break;
+      case AUTOMATION_FREEZE: parameters_.freeze = e.value != 0.0f; break;
+      case AUTOMATION_GATE: parameters_.gate = e.value != 0.0f; break;
+      case AUTOMATION_TRIGGER:
+        // Like the trigger input, at most one trigger per block.
+        if (!parameters_.trigger) {
+          parameters_.trigger = true;
+          // start wraps around when the block began during the previous call
+          // to Process(). Events before start fire at once.
+          parameters_.trigger_offset = e.offset - start < size
+              ? e.offset - start
+              : 0;
+        }
+        break;
+    }
+  }
+  return n;
 }
 
 void GranularProcessor::Process(
     ShortFrame* input,
     ShortFrame* output,
-    size_t size) {
-  // TIC
-  if (silence_ || reset_buffers_ ||
-      previous_playback_mode_ != playback_mode_) {
-    short* output_samples = &output[0].l;
-    fill(&output_samples[0], &output_samples[size << 1], 0);
+    size_t size,
+    const AutomationEvent* events,
+    size_t num_events) {
+  // Large host buffers are split into engine blocks. The background work done
+  // by Prepare() runs between them, as it would with a host running at the
+  // engine block size - so that the output does not depend on the block size.
+  // From the first partial block on, the frames go through a queue instead.
+  if (size % kMaxBlockSize) {
+    queueing_ = true;
+  }
+  if (queueing_) {
+    ProcessQueued(input, output, size, events, num_events);
     return;
   }
+  for (size_t start = 0; start < size; start += kMaxBlockSize) {
+    if (start) {
+      Prepare();
+    }
+    size_t n = ProcessEngine(
+        input + start, kMaxBlockSize, start, events, num_events, &block_);
+    events += n;
+    num_events -= n;
+    ProcessPost(&block_, output + start);
+  }
+}
+
+void GranularProcessor::ProcessQueued(
+    ShortFrame* input,
+    ShortFrame* output,
+    size_t size,
+    const AutomationEvent* events,
+    size_t num_events) {
+  size_t done = 0;
+  while (done < size) {
+    size_t n = min(size - done, kMaxBlockSize - queue_size_);
+    copy(&input[done], &input[done + n], &queue_input_[queue_size_]);
+    copy(
+        &queue_output_[queue_size_], &queue_output_[queue_size_ + n],
+        &output[done]);
+    if (queue_size_ + n < kMaxBlockSize) {
+      queue_size_ += n;
+      break;
+    }
+    if (done) {
+      Prepare();
+    }
+    done += n;
+    // The offset of the first frame of the block in this call wraps around
+    // when the block began during the previous one.
+    n = ProcessEngine(
+        queue_input_, kMaxBlockSize, done - kMaxBlockSize,
+        events, num_events, &block_);
+    events += n;
+    num_events -= n;
+    ProcessPost(&block_, queue_output_);
+    queue_size_ = 0;
+  }
   
-  // Convert input buffers to float, and mixdown for mono processing.
-  for (size_t i = 0; i < size; ++i) {
-    in_[i].l = static_cast<float>(input[i].l) / 32768.0f;
-    in_[i].r = static_cast<float>(input[i].r) / 32768.0f;
+  // The remaining changes fall in the partial block.
+  while (num_events--) {
+    AutomationEvent e = *events++;
+    e.offset += queue_size_ - size;
+    QueueEvent(e);
   }
+}
 
-  if (num_channels_ == 1) {
+void GranularProcessor::QueueEvent(const AutomationEvent& event) {
+  // Only the last change of a parameter, and the first trigger, of a block
+  // have an effect.
+  for (size_t i = 0; i < num_queued_events_; ++i) {
+    if (queued_events_[i].target == event.target) {
+      if (event.target != AUTOMATION_TRIGGER) {
+        queued_events_[i] = event;
+      }
+      return;
+    }
+  }
+  queued_events_[num_queued_events_++] = event;
+}
+
+size_t GranularProcessor::ProcessEngine(
+    ShortFrame* input,
+    size_t size,
+    size_t start,
+    const AutomationEvent* events,
+    size_t num_events,
+    ProcessingBlock* block) {
+  ApplyCommands();
+  
+  // Automated triggers only last one block.
+  bool trigger = parameters_.trigger;
+  if (num_queued_events_) {
+    ApplyAutomation(queued_events_, num_queued_events_, 0, size);
+    num_queued_events_ = 0;
+  }
+  size_t num_applied_events = ApplyAutomation(events, num_events, start, size);
+  bool automated_trigger = parameters_.trigger && !trigger;
+  
+  // The block comes back with the output of the last block processed with it.
+  if (block->type == BLOCK_TYPE_WET) {
+    quiet_samples_ = block->quiet_output ? quiet_samples_ + block->size : 0;
+  }
+  block->size = size;
+  block->playback_mode = playback_mode_;
+  block->mode_change = requested_playback_mode_ != playback_mode_;
+  block->bypass = bypass_;
+  block->inf_reverb = inf_reverb_;
+  
+  if (silence_) {
+    block->type = BLOCK_TYPE_SILENCE;
+  } else if (reset_buffers_ || previous_playback_mode_ != playback_mode_) {
+    // While the engine is being reinitialized, let the dry signal through.
+    // The new engine then fades in.
+    block->type = BLOCK_TYPE_DRY;
     for (size_t i = 0; i < size; ++i) {
-      float xfade = 0.5f;
-      // in mono delay modes, stereo spread controls input crossfade
-      if (playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY ||
-          playback_mode_ == PLAYBACK_MODE_STRETCH)
-        xfade = parameters_.stereo_spread;
-
-      in_[i].l = in_[i].l * (1.0f - xfade) + in_[i].r * xfade;
-      in_[i].r = in_[i].l;
+      block->dry[0][i] = static_cast<float>(input[i].l) / 32768.0f;
+      block->dry[1][i] = static_cast<float>(input[i].r) / 32768.0f;
+    }
+  } else {
+    // Nothing can be heard as long as the input stays silent, unless a
+    // trigger or freeze brings back some material.
+    bool quiet_input = !parameters_.freeze &&
+        !parameters_.trigger &&
+        !parameters_.gate &&
+        IsSilent(input, size);
+    if (!quiet_input) {
+      quiet_samples_ = 0;
+    }
+    block->quiet_output = quiet_input;
+    if (quiet_input && idle()) {
+      block->type = BLOCK_TYPE_IDLE;
+    } else {
+      block->type = BLOCK_TYPE_WET;
+      ProcessEngineBlock(input, block);
     }
   }
   
+  if (automated_trigger) {
+    parameters_.trigger = false;
+    parameters_.trigger_offset = 0;
+  }
+  return num_applied_events;
+}
+
+void GranularProcessor::ProcessEngineBlock(
+    ShortFrame* input,
+    ProcessingBlock* block) {
+  size_t size = block->size;
+  float (*fb)[kMaxBlockSize] = block->feedback;
+  float (*out)[kMaxBlockSize] = block->wet;
+  
+  // The smoothing below is done once per block, with rates tuned for blocks
+  // of 32 samples at 32kHz.
+  float block_rate = kNominalSampleRate / sample_rate_;
+  
   // Apply feedback, with high-pass filtering to prevent build-ups at very
   // low frequencies (causing large DC swings).
   float feedback = parameters_.feedback;
-
-  if (playback_mode_ != PLAYBACK_MODE_OLIVERB &&
-      playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
-    ONE_POLE(freeze_lp_, parameters_.freeze ? 1.0f : 0.0f, 0.0005f)
+  bool apply_feedback = playback_mode_ != PLAYBACK_MODE_OLIVERB &&
+      playback_mode_ != PLAYBACK_MODE_RESONESTOR;
+  float fb_gain = 0.0f;
+  if (apply_feedback) {
+    ONE_POLE(freeze_lp_, parameters_.freeze ? 1.0f : 0.0f, 0.0005f * block_rate)
+    fb_gain = feedback * (2.0f - feedback) * (1.0f - freeze_lp_);
+  }
+  if (fb_filter_tail_.Begin(fb_gain > 0.0f, fb[0], fb[1], size)) {
     float cutoff = (20.0f + 100.0f * feedback * feedback) / sample_rate();
     fb_filter_[0].set_f_q<FREQUENCY_FAST>(cutoff, 0.75f);
     fb_filter_[1].set(fb_filter_[0]);
-    fb_filter_[0].Process<FILTER_MODE_HIGH_PASS>(&fb_[0].l, &fb_[0].l, size, 2);
-    fb_filter_[1].Process<FILTER_MODE_HIGH_PASS>(&fb_[0].r, &fb_[0].r, size, 2);
-    float fb_gain = feedback * (2.0f - feedback) * (1.0f - freeze_lp_);
+    fb_filter_[0].Process<FILTER_MODE_HIGH_PASS>(fb[0], fb[0], size, 1);
+    fb_filter_[1].Process<FILTER_MODE_HIGH_PASS>(fb[1], fb[1], size, 1);
+    fb_filter_tail_.End(fb[0], fb[1], size);
+  } else if (fb_filter_tail_.stopped()) {
+    fb_filter_[0].Init();
+    fb_filter_[1].Init();
+  }
+  
+  // In mono delay modes, stereo spread controls input crossfade.
+  bool mono = num_channels_ == 1;
+  float xfade = 0.5f;
+  if (playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY ||
+      playback_mode_ == PLAYBACK_MODE_STRETCH) {
+    xfade = parameters_.stereo_spread;
+  }
+  
+  // Convert input buffers to float, keeping a copy for the dry signal. Then
+  // mixdown for mono processing and inject feedback, each in its own pass
+  // over contiguous samples.
+  ShortToFloat(input, block->dry[0], block->dry[1], size, 1.0f / 32768.0f);
+  if (mono) {
+    const float* l = block->dry[0];
+    const float* r = block->dry[1];
     for (size_t i = 0; i < size; ++i) {
-      in_[i].l += fb_gain * (
-                             SoftLimit(fb_gain * 1.4f * fb_[i].l + in_[i].l) - in_[i].l);
-      in_[i].r += fb_gain * (
-                             SoftLimit(fb_gain * 1.4f * fb_[i].r + in_[i].r) - in_[i].r);
+      in_[0][i] = l[i] * (1.0f - xfade) + r[i] * xfade;
+    }
+    copy(&in_[0][0], &in_[0][size], &in_[1][0]);
+  } else {
+    copy(&block->dry[0][0], &block->dry[0][size], &in_[0][0]);
+    copy(&block->dry[1][0], &block->dry[1][size], &in_[1][0]);
+  }
+  if (apply_feedback) {
+    for (int32_t channel = 0; channel < 2; ++channel) {
+      float* in = in_[channel];
+      const float* feedback = fb[channel];
+      for (size_t i = 0; i < size; ++i) {
+        float s = in[i];
+        in[i] = s + fb_gain * (SoftLimit(fb_gain * 1.4f * feedback[i] + s) - s);
+      }
     }
   }
   
-  if (low_fidelity_) {
+  if (downsampling_factor_ > 1) {
+    // The trigger offset is counted in host frames - the engine runs at a
+    // fraction of that rate.
+    int32_t trigger_offset = parameters_.trigger_offset;
+    parameters_.trigger_offset /= downsampling_factor_;
     size_t downsampled_size = size / kDownsamplingFactor;
-    src_down_.Process(in_, in_downsampled_,size);
-    ProcessGranular(in_downsampled_, out_downsampled_, downsampled_size);
-    src_up_.Process(out_downsampled_, out_, downsampled_size);
+    src_down_.Process(
+        in_[0], in_[1],
+        in_downsampled_[0], in_downsampled_[1],
+        size);
+    if (downsampling_factor_ == 4) {
+      size_t downsampled_size_4 = downsampled_size / kDownsamplingFactor;
+      src_down_4_.Process(
+          in_downsampled_[0], in_downsampled_[1],
+          in_downsampled_4_[0], in_downsampled_4_[1],
+          downsampled_size);
+      ProcessGranular(
+          in_downsampled_4_[0], in_downsampled_4_[1],
+          out_downsampled_4_[0], out_downsampled_4_[1],
+          downsampled_size_4);
+      src_up_4_.Process(
+          out_downsampled_4_[0], out_downsampled_4_[1],
+          out_downsampled_[0], out_downsampled_[1],
+          downsampled_size_4);
+    } else {
+      ProcessGranular(
+          in_downsampled_[0], in_downsampled_[1],
+          out_downsampled_[0], out_downsampled_[1],
+          downsampled_size);
+    }
+    src_up_.Process(
+        out_downsampled_[0], out_downsampled_[1],
+        out[0], out[1],
+        downsampled_size);
+    parameters_.trigger_offset = trigger_offset;
   } else {
-    ProcessGranular(in_, out_, size);
+    ProcessGranular(in_[0], in_[1], out[0], out[1], size);
   }
   
+  block->pitch_shift = playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY &&
+      (!parameters_.freeze || looper_.synchronized());
+  block->parameters = parameters_;
+}
+
+void GranularProcessor::ProcessPost(
+    ProcessingBlock* block,
+    ShortFrame* output) {
+  size_t size = block->size;
+  if (block->type == BLOCK_TYPE_SILENCE || block->type == BLOCK_TYPE_IDLE) {
+    short* output_samples = &output[0].l;
+    fill(&output_samples[0], &output_samples[size << 1], 0);
+    if (block->type == BLOCK_TYPE_SILENCE || block->mode_change) {
+      mode_fade_ = 0.0f;
+    }
+    return;
+  } else if (block->type == BLOCK_TYPE_DRY) {
+    SoftConvert(block->dry[0], block->dry[1], output, size);
+    mode_fade_ = 0.0f;
+    return;
+  }
+  
+  const Parameters& parameters = block->parameters;
+  PlaybackMode playback_mode = block->playback_mode;
+  float (*dry)[kMaxBlockSize] = block->dry;
+  float (*out)[kMaxBlockSize] = block->wet;
+  float block_rate = kNominalSampleRate / sample_rate_;
+  
   // Diffusion and pitch-shifting post-processings.
-  if (playback_mode_ != PLAYBACK_MODE_SPECTRAL &&
-      playback_mode_ != PLAYBACK_MODE_OLIVERB &&
-      playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
-    float texture = parameters_.texture;
-    float diffusion = playback_mode_ == PLAYBACK_MODE_GRANULAR 
+  if (playback_mode != PLAYBACK_MODE_SPECTRAL &&
+      playback_mode != PLAYBACK_MODE_OLIVERB &&
+      playback_mode != PLAYBACK_MODE_RESONESTOR) {
+    float texture = parameters.texture;
+    float diffusion = playback_mode == PLAYBACK_MODE_GRANULAR 
         ? texture > 0.75f ? (texture - 0.75f) * 4.0f : 0.0f
-        : parameters_.density;
-    diffuser_.set_amount(diffusion);
-    diffuser_.Process(out_, size);
+        : parameters.density;
+    if (diffuser_tail_.Begin(diffusion > 0.0f, out[0], out[1], size)) {
+      diffuser_.set_amount(diffusion);
+      diffuser_.Process(out[0], out[1], size);
+      diffuser_tail_.End(out[0], out[1], size);
+    } else if (diffuser_tail_.stopped()) {
+      diffuser_.Invalidate();
+      diffuser_tail_.set_stale();
+    }
   }
 
-  if (playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY &&
-      (!parameters_.freeze || looper_.synchronized())) {
-    pitch_shifter_.set_ratio(SemitonesToRatio(parameters_.pitch));
-    pitch_shifter_.set_size(parameters_.size);
-    float x = parameters_.pitch;
+  if (block->pitch_shift) {
+    pitch_shifter_.set_ratio(SemitonesToRatio(parameters.pitch));
+    pitch_shifter_.set_size(parameters.size);
+    float x = parameters.pitch;
     const float limit = 0.7f;
     const float slew = 0.4f;
     float wet =
@@ -362,14 +743,20 @@ void GranularProcessor::Process(
       x < limit - slew ? 0.0f :
       x < limit ? 1.0f + (x - limit) / slew:
       1.0f;
-    pitch_shifter_.set_dry_wet(wet);
-    pitch_shifter_.Process(out_, size);
+    if (pitch_shifter_tail_.Begin(wet > 0.0f, out[0], out[1], size)) {
+      pitch_shifter_.set_dry_wet(wet);
+      pitch_shifter_.Process(out[0], out[1], size);
+      pitch_shifter_tail_.End(out[0], out[1], size);
+    } else if (pitch_shifter_tail_.stopped()) {
+      pitch_shifter_.Invalidate();
+      pitch_shifter_tail_.set_stale();
+    }
   }
   
   // Apply filters.
-  if (playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY ||
-      playback_mode_ == PLAYBACK_MODE_STRETCH) {
-    float cutoff = parameters_.texture;
+  if (playback_mode == PLAYBACK_MODE_LOOPING_DELAY ||
+      playback_mode == PLAYBACK_MODE_STRETCH) {
+    float cutoff = parameters.texture;
     float lp_cutoff = 0.5f * SemitonesToRatio(
         (cutoff < 0.5f ? cutoff - 0.5f : 0.0f) * 216.0f);
     float hp_cutoff = 0.25f * SemitonesToRatio(
@@ -378,77 +765,85 @@ void GranularProcessor::Process(
     CONSTRAIN(hp_cutoff, 0.0f, 0.499f);
 
     lp_filter_[0].set_f_q<FREQUENCY_FAST>(lp_cutoff, 0.9f);
-    lp_filter_[0].Process<FILTER_MODE_LOW_PASS>(
-        &out_[0].l, &out_[0].l, size, 2);
+    lp_filter_[0].Process<FILTER_MODE_LOW_PASS>(out[0], out[0], size, 1);
 
     lp_filter_[1].set(lp_filter_[0]);
-    lp_filter_[1].Process<FILTER_MODE_LOW_PASS>(
-        &out_[0].r, &out_[0].r, size, 2);
+    lp_filter_[1].Process<FILTER_MODE_LOW_PASS>(out[1], out[1], size, 1);
 
     hp_filter_[0].set_f_q<FREQUENCY_FAST>(hp_cutoff, 0.9f);
-    hp_filter_[0].Process<FILTER_MODE_HIGH_PASS>(
-        &out_[0].l, &out_[0].l, size, 2);
+    hp_filter_[0].Process<FILTER_MODE_HIGH_PASS>(out[0], out[0], size, 1);
 
     hp_filter_[1].set(hp_filter_[0]);
-    hp_filter_[1].Process<FILTER_MODE_HIGH_PASS>(
-        &out_[0].r, &out_[0].r, size, 2);
+    hp_filter_[1].Process<FILTER_MODE_HIGH_PASS>(out[1], out[1], size, 1);
   }
   
   // This is what is fed back. Reverb is not fed back.
-  copy(&out_[0], &out_[size], &fb_[0]);
+  copy(&out[0][0], &out[0][size], &block->feedback[0][0]);
+  copy(&out[1][0], &out[1][size], &block->feedback[1][0]);
 
   const float post_gain = 1.2f;
 
-  float dw = parameters_.dry_wet;
-  if (bypass_) dw = 0.0f;
-  SLEW(dry_wet_lp_, dw, 0.005f);
+  float dw = parameters.dry_wet;
+  if (block->bypass) dw = 0.0f;
+  SLEW(dry_wet_lp_, dw, 0.005f * block_rate);
 
-  if (playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
+  if (playback_mode != PLAYBACK_MODE_RESONESTOR) {
     ParameterInterpolator dry_wet_mod(&dry_wet_, dry_wet_lp_, size);
     for (size_t i = 0; i < size; ++i) {
       float dry_wet = dry_wet_mod.Next();
       float fade_in = Interpolate(lut_xfade_in, dry_wet, 16.0f);
       float fade_out = Interpolate(lut_xfade_out, dry_wet, 16.0f);
-      float l = static_cast<float>(input[i].l) / 32768.0f;
-      float r = static_cast<float>(input[i].r) / 32768.0f;
-      out_[i].l = l * fade_out + out_[i].l * post_gain * fade_in;
-      out_[i].r = r * fade_out + out_[i].r * post_gain * fade_in;
+      out[0][i] = dry[0][i] * fade_out + out[0][i] * post_gain * fade_in;
+      out[1][i] = dry[1][i] * fade_out + out[1][i] * post_gain * fade_in;
     }
   }
 
   // Apply the simple post-processing reverb.
-  if (playback_mode_ != PLAYBACK_MODE_OLIVERB &&
-      playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
-    float reverb_amount = parameters_.reverb;
-    if (inf_reverb_) reverb_amount = 1.0f;
-    if (bypass_) reverb_amount = 0.0f;
-    static float reverb_amount_lp_ = 0.0f;
-    SLEW(reverb_amount_lp_, reverb_amount, 0.001f);
+  if (playback_mode != PLAYBACK_MODE_OLIVERB &&
+      playback_mode != PLAYBACK_MODE_RESONESTOR) {
+    float reverb_amount = parameters.reverb;
+    if (block->inf_reverb) reverb_amount = 1.0f;
+    if (block->bypass) reverb_amount = 0.0f;
+    SLEW(reverb_amount_lp_, reverb_amount, 0.001f * block_rate);
 
     reverb_.set_amount(reverb_amount_lp_ * 0.54f);
     reverb_.set_diffusion(0.7f);
     reverb_.set_time(0.35f + 0.63f * reverb_amount_lp_);
     reverb_.set_input_gain(0.2f);
-    reverb_.set_lp(0.6f + 0.37f * feedback);
+    reverb_.set_lp(0.6f + 0.37f * parameters.feedback);
 
-    reverb_.Process(out_, size);
+    if (reverb_tail_.Begin(reverb_amount_lp_ > 0.0f, out[0], out[1], size)) {
+      reverb_.Process(out[0], out[1], size);
+      reverb_tail_.End(out[0], out[1], size);
+    } else if (reverb_tail_.stopped()) {
+      reverb_.Invalidate();
+      reverb_tail_.set_stale();
+    }
   }
 
-  for (size_t i = 0; i < size; ++i) {
-    output[i].l = SoftConvert(out_[i].l);
-    output[i].r = SoftConvert(out_[i].r);
+  // When another mode is requested, crossfade to the dry signal. Prepare()
+  // switches engines once the wet signal is gone.
+  float mode_fade_target = block->mode_change ? 0.0f : 1.0f;
+  if (mode_fade_ != 1.0f || mode_fade_target != 1.0f) {
+    float step = 1.0f / (kModeFadeTime * sample_rate_);
+    for (size_t i = 0; i < size; ++i) {
+      SLEW(mode_fade_, mode_fade_target, step);
+      out[0][i] = dry[0][i] + (out[0][i] - dry[0][i]) * mode_fade_;
+      out[1][i] = dry[1][i] + (out[1][i] - dry[1][i]) * mode_fade_;
+    }
   }
 
-  // TOC
+  SoftConvert(out[0], out[1], output, size);
+  block->quiet_output = block->quiet_output && IsSilent(output, size);
 }
 
 void GranularProcessor::PreparePersistentData() {
-  persistent_state_.write_head[0] = low_fidelity_ ?
+  persistent_state_.write_head[0] = resolution() == 8 ?
       buffer_8_[0].head() : buffer_16_[0].head();
-  persistent_state_.write_head[1] = low_fidelity_ ?
+  persistent_state_.write_head[1] = resolution() == 8 ?
       buffer_8_[1].head() : buffer_16_[1].head();
   persistent_state_.quality = quality();
-  persistent_state_.spectral = playback_mode() == PLAYBACK_MODE_SPECTRAL;
+  persistent_state_.spectral = playback_mode_ == PLAYBACK_MODE_SPECTRAL;
 }
 
 void GranularProcessor::GetPersistentData(
@@ -505,13 +900,15 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
       // We can force a switch to this mode, and once everything has been
       // initialized for this mode, we continue with the loop to copy the
       // actual buffer data - with all state variables correctly initialized.
-      Prepare();
+      do {
+        Prepare();
+      } while (!ready());
       GetPersistentData(block, &num_blocks);
     }
   }
   
   // We can finally reset the position of the write heads.
-  if (low_fidelity_) {
+  if (resolution() == 8) {
     buffer_8_[0].Resync(persistent_state_.write_head[0]);
     buffer_8_[1].Resync(persistent_state_.write_head[1]);
   } else {
@@ -523,102 +920,316 @@ bool GranularProcessor::LoadPersistentData(const uint32_t* data) {
   return true;
 }
 
+template<Resolution sample_resolution>
+void GranularProcessor::InitRecordingBuffer(
+    AudioBuffer<sample_resolution>* buffer,
+    AudioBuffer<sample_resolution>* mipmaps,
+    void* memory,
+    size_t memory_size,
+    int16_t* tail_buffer) {
+  size_t sample_size = sample_resolution == RESOLUTION_16_BIT ? 2 : 1;
+  int32_t num_samples = memory_size / sample_size;
+  int32_t levels = num_mipmap_levels_;
+  if (!levels) {
+    buffer->Init(memory, num_samples, tail_buffer);
+    return;
+  }
+  
+  // The buffer and its decimated copies (1/2, 1/4...) share the memory, each
+  // with its own interpolation tail. The size of the buffer must be a
+  // multiple of 2^levels for the write heads to stay aligned.
+  int32_t size = ((num_samples - (levels + 1) * kInterpolationTail) << levels)
+      / ((2 << levels) - 1);
+  size &= ~((1 << levels) - 1);
+  
+  uint8_t* ptr = static_cast<uint8_t*>(memory);
+  buffer->Init(ptr, size + kInterpolationTail, tail_buffer);
+  ptr += (size + kInterpolationTail) * sample_size;
+  AudioBuffer<sample_resolution>* parent = buffer;
+  for (int32_t i = 0; i < levels; ++i) {
+    size >>= 1;
+    mipmaps[i].Init(ptr, size + kInterpolationTail, NULL);
+    ptr += (size + kInterpolationTail) * sample_size;
+    parent->AttachMipmap(&mipmaps[i]);
+    parent = &mipmaps[i];
+  }
+}
+
+bool GranularProcessor::InitSomeMemory() {
+  switch (init_step_) {
+    case INIT_STEP_LAYOUT:
+      {
+        parameters_.freeze = false;
+        void* workspace;
+        size_t workspace_size;
+        if (num_channels_ == 1) {
+          // Large buffer: 120k of sample memory.
+          // small buffer: fully allocated to FX workspace.
+          sample_buffer_[0] = buffer_[0];
+          sample_buffer_size_[0] = buffer_size_[0];
+          sample_buffer_[1] = NULL;
+          sample_buffer_size_[1] = 0;
+          workspace = buffer_[1];
+          workspace_size = buffer_size_[1];
+        } else {
+          // Large buffer: 64k of sample memory + FX workspace.
+          // small buffer: 64k of sample memory.
+          sample_buffer_size_[0] = sample_buffer_size_[1] = buffer_size_[1];
+          sample_buffer_[0] = buffer_[0];
+          sample_buffer_[1] = buffer_[1];
+      
+          workspace_size = buffer_size_[0] - buffer_size_[1];
+          workspace = static_cast<uint8_t*>(buffer_[0]) + buffer_size_[1];
+        }
+
+        // Above the nominal sample rate, the delay lines of the effects are
+        // stretched to keep their durations, when the workspace is large
+        // enough. Otherwise, they keep their lengths in samples, which is the
+        // layout the memory of the module is sized for.
+        delay_scale_ = sample_rate_ / kNominalSampleRate;
+        if (!AllocateWorkspace(workspace, workspace_size)) {
+          delay_scale_ = 1.0f;
+          AllocateWorkspace(workspace, workspace_size);
+        }
+        
+        // The tails are held for as long as the longest loop, and for at
+        // least as long as at the nominal sample rate.
+        float hold = max(delay_scale_, sample_rate_ / kNominalSampleRate);
+        fb_filter_tail_.set_hold(hold);
+        diffuser_tail_.set_hold(hold);
+        pitch_shifter_tail_.set_hold(hold);
+        reverb_tail_.set_hold(hold);
+      }
+      break;
+    
+    case INIT_STEP_REVERB:
+      InitReverb();
+      break;
+    
+    case INIT_STEP_CLEAR_REVERB:
+      if (!ClearSomeReverb()) {
+        return false;
+      }
+      break;
+    
+    case INIT_STEP_ENGINE:
+      if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
+        phase_vocoder_.Init(
+            sample_buffer_, sample_buffer_size_,
+            lut_sine_window_4096, 4096,
+            num_channels_, resolution(), sample_rate(), &random_);
+      } else if (playback_mode_ == PLAYBACK_MODE_RESONESTOR) {
+        float* buf = (float*)sample_buffer_[0];
+        float delay_scale = delay_scale_;
+        if (delay_scale > 1.0f && Resonestor::memory_size(delay_scale) * \
+                sizeof(float) > sample_buffer_size_[0]) {
+          delay_scale = 1.0f;
+        }
+        resonestor_.Init(buf, sample_rate_, delay_scale, &random_);
+      } else {
+        for (int32_t i = 0; i < num_channels_; ++i) {
+          if (resolution() == 8) {
+            InitRecordingBuffer(
+                &buffer_8_[i],
+                mipmap_8_[i],
+                sample_buffer_[i],
+                sample_buffer_size_[i],
+                tail_buffer_[i]);
+            buffer_8_[i].AttachSummary(block_summary_[i]);
+          } else {
+            InitRecordingBuffer(
+                &buffer_16_[i],
+                mipmap_16_[i],
+                sample_buffer_[i],
+                sample_buffer_size_[i],
+                tail_buffer_[i]);
+            buffer_16_[i].AttachSummary(block_summary_[i]);
+          }
+        }
+        int32_t num_grains = (num_channels_ == 1 ? 32 : 26) * \
+            (downsampling_factor_ > 1 ? 20 : 16) >> 4;
+        player_.Init(&random_, num_channels_, num_grains, sample_rate_);
+        ws_player_.Init(&correlator_, num_channels_);
+        looper_.Init(num_channels_);
+      }
+      break;
+    
+    case INIT_STEP_CLEAR:
+      if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
+        if (!phase_vocoder_.ClearSome(kInitChunkSize)) {
+          return false;
+        }
+      } else if (playback_mode_ == PLAYBACK_MODE_RESONESTOR) {
+        if (!resonestor_.ClearSome(kInitChunkSize)) {
+          return false;
+        }
+      } else {
+        bool done = true;
+        for (int32_t i = 0; i < num_channels_; ++i) {
+          done = (resolution() == 8
+              ? buffer_8_[i].ClearSome(kInitChunkSize)
+              : buffer_16_[i].ClearSome(kInitChunkSize)) && done;
+        }
+        if (!done) {
+          return false;
+        }
+      }
+      
+      // The whole recording buffer must have been overwritten with silence.
+      idle_hold_samples_ = kMinIdleHoldSamples;
+      if (playback_mode_ != PLAYBACK_MODE_SPECTRAL &&
+          playback_mode_ != PLAYBACK_MODE_RESONESTOR) {
+        int32_t recording_size = resolution() == 8
+            ? buffer_8_[0].size()
+            : buffer_16_[0].size();
+        recording_size *= downsampling_factor_;
+        idle_hold_samples_ = max(idle_hold_samples_, recording_size);
+      }
+      quiet_samples_ = 0;
+      init_step_ = INIT_STEP_LAYOUT;
+      return true;
+  }
+  init_step_ = static_cast<InitStep>(init_step_ + 1);
+  return false;
+}
+
+bool GranularProcessor::AllocateWorkspace(
+    void* workspace,
+    size_t workspace_size) {
+  BufferAllocator allocator(workspace, workspace_size);
+  float* diffuser_buffer = allocator.Allocate<float>(
+      Diffuser::memory_size(delay_scale_));
+  if (!diffuser_buffer) {
+    return false;
+  }
+  // Oliverb and the post-processing reverb share their memory.
+  reverb_buffer_ = allocator.Allocate<uint16_t>(max(
+      Reverb::memory_size(delay_scale_),
+      Oliverb::memory_size(delay_scale_)));
+  if (!reverb_buffer_) {
+    return false;
+  }
+  
+  // Level summaries of the recording buffers. They are allocated before the
+  // correlator data, since the pitch shifter's delay line, which shares its
+  // memory, extends beyond it.
+  for (int32_t i = 0; i < num_channels_; ++i) {
+    size_t num_samples = sample_buffer_size_[i] >> \
+        (resolution() == 8 ? 0 : 1);
+    block_summary_[i] = allocator.Allocate<BlockSummary>(
+        (num_samples + kSummaryBlockSize - 1) >> kSummaryBlockSizeBits);
+    if (!block_summary_[i]) {
+      return false;
+    }
+  }
+  
+  size_t correlator_block_size = (kMaxWSOLASize / 32) + 2;
+  size_t correlator_size = correlator_block_size * 3 * sizeof(uint32_t);
+  size_t pitch_shifter_size = PitchShifter::memory_size(delay_scale_) * \
+      sizeof(uint16_t);
+  uint32_t* correlator_data = allocator.Allocate<uint32_t>(
+      correlator_block_size * 3);
+  if (!correlator_data || (pitch_shifter_size > correlator_size &&
+      !allocator.Allocate<uint8_t>(pitch_shifter_size - correlator_size))) {
+    return false;
+  }
+  
+  diffuser_.Init(diffuser_buffer, delay_scale_);
+  correlator_.Init(
+      &correlator_data[0],
+      &correlator_data[correlator_block_size]);
+  pitch_shifter_.Init((uint16_t*)correlator_data, delay_scale_);
+  return true;
+}
+
+void GranularProcessor::InitReverb() {
+  // Oliverb and the post-processing reverb share their memory.
+  if (playback_mode_ == PLAYBACK_MODE_OLIVERB) {
+    oliverb_.Init(reverb_buffer_, delay_scale_, &random_);
+  } else {
+    reverb_.Init(reverb_buffer_, sample_rate_, delay_scale_);
+  }
+}
+
+bool GranularProcessor::ClearSomeReverb() {
+  return playback_mode_ == PLAYBACK_MODE_OLIVERB
+      ? oliverb_.ClearSome(kInitChunkSize)
+      : reverb_.ClearSome(kInitChunkSize);
+}
+
+void GranularProcessor::ClearSomeStaleMemory() {
+  // The pitch shifter shares its memory with the correlator, and the reverb
+  // with the Oliverb: theirs is only cleared in the modes using them.
+  if (diffuser_tail_.stale()) {
+    if (diffuser_.ClearSome(kInitChunkSize)) {
+      diffuser_tail_.Cleared();
+    }
+  } else if (pitch_shifter_tail_.stale() &&
+             playback_mode_ == PLAYBACK_MODE_LOOPING_DELAY) {
+    if (pitch_shifter_.ClearSome(kInitChunkSize)) {
+      pitch_shifter_tail_.Cleared();
+    }
+  } else if (reverb_tail_.stale() &&
+             playback_mode_ != PLAYBACK_MODE_OLIVERB) {
+    if (reverb_.ClearSome(kInitChunkSize)) {
+      reverb_tail_.Cleared();
+    }
+  }
+}
+
 void GranularProcessor::Prepare() {
+  if (__atomic_load_n(&pending_quality_, __ATOMIC_RELAXED) != -1) {
+    set_quality(__atomic_exchange_n(&pending_quality_, -1, __ATOMIC_RELAXED));
+  }
+  
+  // The requested mode is engaged once the current one has faded out, and
+  // once the reinitialization of the previous one is complete.
+  if (requested_playback_mode_ != playback_mode_ &&
+      init_step_ == INIT_STEP_LAYOUT &&
+      (silence_ || mode_fade_ == 0.0f)) {
+    playback_mode_ = requested_playback_mode_;
+  }
+  
+  // Only the spectral and resonestor modes use the sample memory differently.
+  // Between the other modes, the recording buffer is kept.
   bool playback_mode_changed = previous_playback_mode_ != playback_mode_;
   bool benign_change = previous_playback_mode_ != PLAYBACK_MODE_SPECTRAL
     && playback_mode_ != PLAYBACK_MODE_SPECTRAL
     && playback_mode_ != PLAYBACK_MODE_RESONESTOR
     && previous_playback_mode_ != PLAYBACK_MODE_RESONESTOR
-    && playback_mode_ != PLAYBACK_MODE_OLIVERB
-    && previous_playback_mode_ != PLAYBACK_MODE_OLIVERB
     && previous_playback_mode_ != PLAYBACK_MODE_LAST;
   
   if (!reset_buffers_ && playback_mode_changed && benign_change) {
+    // When switching to or from the Oliverb, the reverb memory is cleared over
+    // several calls. The dry signal is passed meanwhile.
+    if (playback_mode_ == PLAYBACK_MODE_OLIVERB ||
+        previous_playback_mode_ == PLAYBACK_MODE_OLIVERB) {
+      if (init_step_ == INIT_STEP_LAYOUT) {
+        InitReverb();
+        init_step_ = INIT_STEP_CLEAR_REVERB;
+      }
+      if (!ClearSomeReverb()) {
+        return;
+      }
+      init_step_ = INIT_STEP_LAYOUT;
+    }
     ResetFilters();
     pitch_shifter_.Clear();
     previous_playback_mode_ = playback_mode_;
   }
   
-  if ((playback_mode_changed && !benign_change) || reset_buffers_) {
-    parameters_.freeze = false;
-  }
-
   if (reset_buffers_ || (playback_mode_changed && !benign_change)) {
-    void* buffer[2];
-    size_t buffer_size[2];
-    void* workspace;
-    size_t workspace_size;
-    if (num_channels_ == 1) {
-      // Large buffer: 120k of sample memory.
-      // small buffer: fully allocated to FX workspace.
-      buffer[0] = buffer_[0];
-      buffer_size[0] = buffer_size_[0];
-      buffer[1] = NULL;
-      buffer_size[1] = 0;
-      workspace = buffer_[1];
-      workspace_size = buffer_size_[1];
-    } else {
-      // Large buffer: 64k of sample memory + FX workspace.
-      // small buffer: 64k of sample memory.
-      buffer_size[0] = buffer_size[1] = buffer_size_[1];
-      buffer[0] = buffer_[0];
-      buffer[1] = buffer_[1];
-      
-      workspace_size = buffer_size_[0] - buffer_size_[1];
-      workspace = static_cast<uint8_t*>(buffer[0]) + buffer_size[0];
+    if (InitSomeMemory()) {
+      reset_buffers_ = false;
+      previous_playback_mode_ = playback_mode_;
     }
-    float sr = sample_rate();
-
-    BufferAllocator allocator(workspace, workspace_size);
-    diffuser_.Init(allocator.Allocate<float>(2048));
-
-    uint16_t* reverb_buffer = allocator.Allocate<uint16_t>(16384);
-    if (playback_mode_ == PLAYBACK_MODE_OLIVERB) {
-      oliverb_.Init(reverb_buffer);
-    } else {
-      reverb_.Init(reverb_buffer);
-    }
-
-    size_t correlator_block_size = (kMaxWSOLASize / 32) + 2;
-    uint32_t* correlator_data = allocator.Allocate<uint32_t>(
-        correlator_block_size * 3);
-    correlator_.Init(
-        &correlator_data[0],
-        &correlator_data[correlator_block_size]);
-    pitch_shifter_.Init((uint16_t*)correlator_data);
-    
-    if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
-      phase_vocoder_.Init(
-          buffer, buffer_size,
-          lut_sine_window_4096, 4096,
-          num_channels_, resolution(), sr);
-    } else if (playback_mode_ == PLAYBACK_MODE_RESONESTOR) {
-      float* buf = (float*)buffer[0];
-      resonestor_.Init(buf);
-    } else {
-      for (int32_t i = 0; i < num_channels_; ++i) {
-        if (resolution() == 8) {
-          buffer_8_[i].Init(
-              buffer[i],
-              (buffer_size[i]),
-              tail_buffer_[i]);
-        } else {
-          buffer_16_[i].Init(
-              buffer[i],
-              ((buffer_size[i]) >> 1),
-              tail_buffer_[i]);
-        }
-      }
-      int32_t num_grains = (num_channels_ == 1 ? 32 : 26) * \
-          (low_fidelity_ ? 20 : 16) >> 4;
-      player_.Init(num_channels_, num_grains);
-      ws_player_.Init(&correlator_, num_channels_);
-      looper_.Init(num_channels_);
-    }
-    reset_buffers_ = false;
-    previous_playback_mode_ = playback_mode_;
+    return;
   }
   
+  // Skipped post-processing stages only run again once their memory has been
+  // cleared, a chunk at a time.
+  ClearSomeStaleMemory();
+  
   if (playback_mode_ == PLAYBACK_MODE_SPECTRAL) {
     phase_vocoder_.Buffer();
   } else if (playback_mode_ == PLAYBACK_MODE_STRETCH ||
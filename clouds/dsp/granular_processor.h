@@ -30,25 +30,69 @@
 #define CLOUDS_DSP_GRANULAR_PROCESSOR_H_
 
 #include "stmlib/stmlib.h"
+
+#include <algorithm>
+
 #include "stmlib/dsp/filter.h"
 
+#include "clouds/dsp/control_channel.h"
 #include "clouds/dsp/correlator.h"
 #include "clouds/dsp/frame.h"
 #include "clouds/dsp/fx/diffuser.h"
 #include "clouds/dsp/fx/pitch_shifter.h"
 #include "clouds/dsp/fx/reverb.h"
+#include "clouds/dsp/fx/tail_detector.h"
 #include "clouds/dsp/resonestor.h"
 #include "clouds/dsp/fx/oliverb.h"
 #include "clouds/dsp/granular_processor.h"
 #include "clouds/dsp/granular_sample_player.h"
 #include "clouds/dsp/looping_sample_player.h"
 #include "clouds/dsp/pvoc/phase_vocoder.h"
+#include "clouds/dsp/random.h"
 #include "clouds/dsp/sample_rate_converter.h"
 #include "clouds/dsp/wsola_sample_player.h"
+#include "clouds/resources.h"
 
 namespace clouds {
 
+// Decimation of one sample rate converter stage. The lowest quality cascades
+// two of them. When decimating, the engine must process multiples of the
+// decimation factor: hosts can process multiples of kMaxDownsamplingFactor.
 const int32_t kDownsamplingFactor = 2;
+const int32_t kMaxDownsamplingFactor = 4;
+
+#ifdef TEST
+// Host builds can pick any of the half-band filters of the sample rate
+// converters.
+const int32_t kMaxSrcFilter = SRC_FILTER_1X_2_91;
+const int32_t kMaxSrcFilterSize = SRC_FILTER_1X_2_91_SIZE;
+#else
+// On the module, the converters sit in SRAM next to the sample memory: their
+// history and coefficients are only sized for the default 45-tap filter.
+const int32_t kMaxSrcFilter = SRC_FILTER_1X_2_45;
+const int32_t kMaxSrcFilterSize = SRC_FILTER_1X_2_45_SIZE;
+#endif  // TEST
+
+// Bit 0 of the quality selects mono, bits 1-2 the decimation of the
+// recording: none (16-bit samples), by 2 or by 4 (8-bit samples).
+const int32_t kNumQualities = 6;
+
+// Below this level (in 16-bit units), input and output count as silence.
+const int32_t kIdleThreshold = 8;
+
+// Minimum duration of silence before idling - longer than the reverb and
+// spectral textures memory.
+const int32_t kMinIdleHoldSamples = 32768;
+
+// Number of samples of the recording buffer cleared by each call to Prepare()
+// after a reset.
+const int32_t kInitChunkSize = 4096;
+
+// Duration (in seconds) of the crossfades when switching modes.
+const float kModeFadeTime = 0.02f;
+
+// Number of commands that can be posted between two calls to Process().
+const size_t kCommandQueueSize = 16;
 
 enum PlaybackMode {
   PLAYBACK_MODE_GRANULAR,
@@ -60,6 +104,92 @@ enum PlaybackMode {
   PLAYBACK_MODE_LAST
 };
 
+enum CommandType {
+  COMMAND_TOGGLE_FREEZE,
+  COMMAND_TOGGLE_REVERSE,
+  COMMAND_TOGGLE_BYPASS,
+  COMMAND_SET_BYPASS,
+  COMMAND_SET_INF_REVERB,
+  COMMAND_SET_PLAYBACK_MODE,
+  COMMAND_SET_QUALITY,
+  COMMAND_SET_SRC_FILTER
+};
+
+// Change of state posted from a control context, and applied by the audio
+// context at the beginning of the next block.
+struct Command {
+  CommandType type;
+  int32_t argument;
+};
+
+enum AutomationTarget {
+  AUTOMATION_POSITION,
+  AUTOMATION_SIZE,
+  AUTOMATION_PITCH,
+  AUTOMATION_DENSITY,
+  AUTOMATION_TEXTURE,
+  AUTOMATION_DRY_WET,
+  AUTOMATION_STEREO_SPREAD,
+  AUTOMATION_FEEDBACK,
+  AUTOMATION_REVERB,
+  AUTOMATION_FREEZE,
+  AUTOMATION_GATE,
+  AUTOMATION_TRIGGER
+};
+
+const size_t kNumAutomationTargets = AUTOMATION_TRIGGER + 1;
+
+// Change of a parameter, or trigger, at a given sample of the buffer passed
+// to Process().
+struct AutomationEvent {
+  size_t offset;
+  AutomationTarget target;
+  float value;
+};
+
+enum BlockType {
+  BLOCK_TYPE_SILENCE,
+  BLOCK_TYPE_DRY,
+  BLOCK_TYPE_IDLE,
+  BLOCK_TYPE_WET
+};
+
+// Block handed over from the playback engine to the post-processing chain.
+// It carries the output of the chain back to the engine, to be fed back.
+struct ProcessingBlock {
+  BlockType type;
+  size_t size;
+  Parameters parameters;
+  PlaybackMode playback_mode;
+  bool mode_change;
+  bool bypass;
+  bool inf_reverb;
+  bool pitch_shift;
+  bool quiet_output;
+  
+  float dry[kMaxNumChannels][kMaxBlockSize];
+  float wet[kMaxNumChannels][kMaxBlockSize];
+  float feedback[kMaxNumChannels][kMaxBlockSize];
+  
+  void Init() {
+    type = BLOCK_TYPE_SILENCE;
+    size = 0;
+    for (int32_t i = 0; i < kMaxNumChannels; ++i) {
+      std::fill(&feedback[i][0], &feedback[i][kMaxBlockSize], 0.0f);
+    }
+  }
+};
+
+// Steps of the reinitialization of the sample memory, one per call to
+// Prepare().
+enum InitStep {
+  INIT_STEP_LAYOUT,
+  INIT_STEP_REVERB,
+  INIT_STEP_CLEAR_REVERB,
+  INIT_STEP_ENGINE,
+  INIT_STEP_CLEAR
+};
+
 // State of the recording buffer as saved in one of the 4 sample memories.
 struct PersistentState {
   int32_t write_head[2];
@@ -85,7 +215,40 @@ class GranularProcessor {
       void* small_buffer,
       size_t small_buffer_size);
 
-  void Process(ShortFrame* input, ShortFrame* output, size_t size);
+  // Work is done by whole blocks of kMaxBlockSize frames, so that the output
+  // does not depend on how the audio is split. Sizes which are multiples of
+  // kMaxBlockSize are processed in place. From the first call with any other
+  // size on, the frames are queued until they make a whole block, and the
+  // output is delayed by one block - see latency().
+  inline void Process(ShortFrame* input, ShortFrame* output, size_t size) {
+    Process(input, output, size, NULL, 0);
+  }
+  
+  // Same, with a list of parameter changes and triggers sorted by offset.
+  // Changes are applied at the beginning of the engine block containing them,
+  // just as with a control rate of one block; triggers fire at their exact
+  // sample. Large host buffers thus sound the same as small ones.
+  void Process(
+      ShortFrame* input,
+      ShortFrame* output,
+      size_t size,
+      const AutomationEvent* events,
+      size_t num_events);
+  
+  // The two stages of the processing of a block of at most kMaxBlockSize
+  // frames, for hosts running them on different threads - see
+  // PipelinedProcessor. ProcessEngine() fills the block, ProcessPost() then
+  // renders its output. The offsets of the events are relative to start.
+  // Returns the number of events consumed.
+  size_t ProcessEngine(
+      ShortFrame* input,
+      size_t size,
+      size_t start,
+      const AutomationEvent* events,
+      size_t num_events,
+      ProcessingBlock* block);
+  void ProcessPost(ProcessingBlock* block, ShortFrame* output);
+  
   void Prepare();
   
   inline Parameters* mutable_parameters() {
@@ -96,6 +259,37 @@ class GranularProcessor {
     return parameters_;
   }
   
+  // Thread-safe alternative to mutable_parameters() for a control context
+  // other than the one calling Process(): the parameters are written here,
+  // then published together. Process() picks the latest published set when
+  // it starts, so a block never sees a half-written one. Once published,
+  // they replace all the fields of parameters(), freeze and reverse included.
+  inline Parameters* mutable_pending_parameters() {
+    return pending_parameters_.mutable_back();
+  }
+  
+  inline void PublishParameters() {
+    pending_parameters_.Publish();
+  }
+  
+  // Thread-safe alternative to the setters below. Returns false if the queue
+  // is full. Commands are applied at the beginning of the next block, after
+  // the published parameters.
+  inline bool Post(CommandType type, int32_t argument) {
+    Command command = { type, argument };
+    return commands_.Push(command);
+  }
+  
+  inline bool Post(CommandType type) {
+    return Post(type, 0);
+  }
+  
+  // Seeds the random generator used by all the engines of this instance.
+  // Init() seeds it with kDefaultRandomSeed.
+  inline void Seed(uint32_t seed) {
+    random_.Seed(seed);
+  }
+  
   inline void ToggleFreeze() {
     parameters_.freeze = !parameters_.freeze;
   }
@@ -112,7 +306,7 @@ class GranularProcessor {
     inf_reverb_ = state;
   }
 
-  inline bool inf_reverb() {
+  inline bool inf_reverb() const {
     return inf_reverb_;
   }
 
@@ -124,6 +318,38 @@ class GranularProcessor {
     return parameters_.granular.reverse;
   }
 
+  // False while the sample memory is being reinitialized, which takes a few
+  // calls to Prepare(). Meanwhile, the dry signal is passed through.
+  inline bool ready() const {
+    return !reset_buffers_ && previous_playback_mode_ == playback_mode_;
+  }
+  
+  // False when the next call to Prepare() might reconfigure the
+  // post-processing chain. It must not run concurrently with ProcessPost()
+  // then.
+  inline bool stable() const {
+    return ready() && requested_playback_mode_ == playback_mode_ &&
+        __atomic_load_n(&pending_quality_, __ATOMIC_RELAXED) == -1;
+  }
+  
+  // True when input and output have been silent long enough for the
+  // recording buffer and all effect tails to be empty. Process then only
+  // outputs zeros.
+  inline bool idle() const {
+    return quiet_samples_ >= idle_hold_samples_;
+  }
+  
+  // Delay, in frames, added by Process() to the output.
+  inline size_t latency() const {
+    return queueing_ ? kMaxBlockSize : 0;
+  }
+  
+  // Number of samples the output can last after the input has become silent,
+  // unless it is sustained by freeze, feedback or the infinite reverb.
+  inline int32_t tail_length() const {
+    return idle_hold_samples_;
+  }
+
   inline void set_silence(bool silence) {
     silence_ = silence;
   }
@@ -134,66 +360,177 @@ class GranularProcessor {
 
   inline bool bypass() { return bypass_; }
 
+  // The new mode is engaged after a short crossfade.
   inline void set_playback_mode(PlaybackMode playback_mode) {
-    playback_mode_ = playback_mode;
+    requested_playback_mode_ = playback_mode;
   }
   
-  inline PlaybackMode playback_mode() const { return playback_mode_; }
+  inline PlaybackMode playback_mode() const {
+    return requested_playback_mode_;
+  }
   
   inline void set_quality(int32_t quality) {
+    CONSTRAIN(quality, 0, kNumQualities - 1);
     set_num_channels(quality & 1 ? 1 : 2);
-    set_low_fidelity(quality >> 1 ? true : false);
+    set_downsampling_factor(1 << (quality >> 1));
   }
   
   inline void set_num_channels(int32_t num_channels) {
-    reset_buffers_ = reset_buffers_ || num_channels_ != num_channels;
+    if (num_channels != num_channels_) {
+      ScheduleReset();
+    }
     num_channels_ = num_channels;
   }
   
+  // Changing the sample rate reinitializes the buffers and effects.
+  inline void set_sample_rate(float sample_rate) {
+    if (sample_rate != sample_rate_) {
+      ScheduleReset();
+    }
+    sample_rate_ = sample_rate;
+  }
+  
   inline void set_low_fidelity(bool low_fidelity) {
-    reset_buffers_ = reset_buffers_ || low_fidelity != low_fidelity_;
-    low_fidelity_ = low_fidelity;
+    set_downsampling_factor(low_fidelity ? kDownsamplingFactor : 1);
   }
   
+  // 1, 2 or 4.
+  inline void set_downsampling_factor(int32_t downsampling_factor) {
+    if (downsampling_factor != downsampling_factor_) {
+      ScheduleReset();
+    }
+    downsampling_factor_ = downsampling_factor;
+  }
+  
+  inline int32_t downsampling_factor() const { return downsampling_factor_; }
+  
+  // Half-band filter of the sample rate converters used in the low fidelity
+  // qualities - by all the stages, SRC_FILTER_1X_2_31 to kMaxSrcFilter: the
+  // shorter ones cost less and delay less, the longer ones alias less.
+  // Clears the converters.
+  inline void set_src_filter(int32_t src_filter) {
+    CONSTRAIN(src_filter, SRC_FILTER_1X_2_31, kMaxSrcFilter);
+    if (src_filter != src_filter_) {
+      src_filter_ = src_filter;
+      InitSampleRateConverters();
+    }
+  }
+  
+  inline int32_t src_filter() const { return src_filter_; }
+  
   inline int32_t quality() const {
     int32_t quality = 0;
     if (num_channels_ == 1) quality |= 1;
-    if (low_fidelity_) quality |= 2;
+    if (downsampling_factor_ == 2) quality |= 2;
+    if (downsampling_factor_ == 4) quality |= 4;
     return quality;
   }
   
+  // Number of decimated copies of the recording buffer (0 to
+  // kMaxMipmapLevels) used when playing back transposed up by more than an
+  // octave. They are carved from the sample memory, reducing the recording
+  // time.
+  inline void set_num_mipmap_levels(int32_t num_mipmap_levels) {
+    CONSTRAIN(num_mipmap_levels, 0, kMaxMipmapLevels);
+    if (num_mipmap_levels != num_mipmap_levels_) {
+      ScheduleReset();
+    }
+    num_mipmap_levels_ = num_mipmap_levels;
+  }
+  
+  inline int32_t num_mipmap_levels() const { return num_mipmap_levels_; }
+  
   void GetPersistentData(PersistentBlock* block, size_t *num_blocks);
   bool LoadPersistentData(const uint32_t* data);
   void PreparePersistentData();
 
  private:
   inline int32_t resolution() const {
-    return low_fidelity_ ? 8 : 16;
+    return downsampling_factor_ > 1 ? 8 : 16;
   }
 
   inline float sample_rate() const {
-    return 32000.0f / \
-        (low_fidelity_ ? kDownsamplingFactor : 1);
+    return sample_rate_ / static_cast<float>(downsampling_factor_);
   }
      
+  template<Resolution sample_resolution>
+  void InitRecordingBuffer(
+      AudioBuffer<sample_resolution>* buffer,
+      AudioBuffer<sample_resolution>* mipmaps,
+      void* memory,
+      size_t memory_size,
+      int16_t* tail_buffer);
+  
   void ResetFilters();
-  void ProcessGranular(FloatFrame* input, FloatFrame* output, size_t size);
+  void InitSampleRateConverters();
+  bool InitSomeMemory();
+  bool AllocateWorkspace(void* workspace, size_t workspace_size);
+  void InitReverb();
+  bool ClearSomeReverb();
+  void ClearSomeStaleMemory();
+  
+  inline void ScheduleReset() {
+    reset_buffers_ = true;
+    init_step_ = INIT_STEP_LAYOUT;
+  }
+  
+  void ApplyCommands();
+  void ProcessQueued(
+      ShortFrame* input,
+      ShortFrame* output,
+      size_t size,
+      const AutomationEvent* events,
+      size_t num_events);
+  void QueueEvent(const AutomationEvent& event);
+  size_t ApplyAutomation(
+      const AutomationEvent* events,
+      size_t num_events,
+      size_t start,
+      size_t size);
+  void ProcessEngineBlock(ShortFrame* input, ProcessingBlock* block);
+  static bool IsSilent(const ShortFrame* frames, size_t size);
+  void ProcessGranular(
+      const float* input_l,
+      const float* input_r,
+      float* output_l,
+      float* output_r,
+      size_t size);
 
   PlaybackMode playback_mode_;
   PlaybackMode previous_playback_mode_;
+  PlaybackMode requested_playback_mode_;
+  float mode_fade_;
   int32_t num_channels_;
-  bool low_fidelity_;
+  int32_t num_mipmap_levels_;
+  int32_t downsampling_factor_;
+  float sample_rate_;
+  // Stretch of the delay lines of the effects.
+  float delay_scale_;
   
   bool silence_;
   bool bypass_;
   bool inf_reverb_;
   bool reset_buffers_;
+  InitStep init_step_;
   float freeze_lp_;
   float dry_wet_, dry_wet_lp_;
+  float reverb_amount_lp_;
+  int32_t quiet_samples_;
+  int32_t idle_hold_samples_;
+  
+  // Changing the quality reorganizes the sample memory, so a posted change is
+  // only applied by Prepare().
+  int32_t pending_quality_;
 
   void* buffer_[2];
   size_t buffer_size_[2];
   
+  // Sample memory of the playback engines, as carved from the buffers above.
+  void* sample_buffer_[2];
+  size_t sample_buffer_size_[2];
+  BlockSummary* block_summary_[2];
+  
+  RandomGenerator random_;
   Correlator correlator_;
   
   GranularSamplePlayer player_;
@@ -201,6 +538,7 @@ class GranularProcessor {
   LoopingSamplePlayer looper_;
   PhaseVocoder phase_vocoder_;
   
+  uint16_t* reverb_buffer_;
   Diffuser diffuser_;
   Reverb reverb_;
   Oliverb oliverb_;
@@ -210,21 +548,51 @@ class GranularProcessor {
   stmlib::Svf hp_filter_[2];
   stmlib::Svf lp_filter_[2];
   
+  // Activity of the post-processing stages, so that idle ones can be skipped.
+  TailDetector fb_filter_tail_;
+  TailDetector diffuser_tail_;
+  TailDetector pitch_shifter_tail_;
+  TailDetector reverb_tail_;
+  
   AudioBuffer<RESOLUTION_8_BIT_MU_LAW> buffer_8_[2];
   AudioBuffer<RESOLUTION_16_BIT> buffer_16_[2];
+  AudioBuffer<RESOLUTION_8_BIT_MU_LAW> mipmap_8_[2][kMaxMipmapLevels];
+  AudioBuffer<RESOLUTION_16_BIT> mipmap_16_[2][kMaxMipmapLevels];
+  
+  // The post-processing chain works on separate left and right channels.
+  float in_[kMaxNumChannels][kMaxBlockSize];
+  float in_downsampled_[kMaxNumChannels][kMaxBlockSize / kDownsamplingFactor];
+  float out_downsampled_[kMaxNumChannels][kMaxBlockSize / kDownsamplingFactor];
+  float in_downsampled_4_[kMaxNumChannels][kMaxBlockSize / 4];
+  float out_downsampled_4_[kMaxNumChannels][kMaxBlockSize / 4];
+  ProcessingBlock block_;
+  
+  // Frames of a partial block, waiting for the next call to Process(); the
+  // output of the last block; and the changes falling in the partial block,
+  // with offsets relative to its first frame.
+  bool queueing_;
+  size_t queue_size_;
+  ShortFrame queue_input_[kMaxBlockSize];
+  ShortFrame queue_output_[kMaxBlockSize];
+  AutomationEvent queued_events_[kNumAutomationTargets];
+  size_t num_queued_events_;
   
-  FloatFrame in_[kMaxBlockSize];
-  FloatFrame in_downsampled_[kMaxBlockSize / kDownsamplingFactor];
-  FloatFrame out_downsampled_[kMaxBlockSize / kDownsamplingFactor];
-  FloatFrame out_[kMaxBlockSize];
-  FloatFrame fb_[kMaxBlockSize];
+  // Interleaved input and output of the playback engines.
+  FloatFrame engine_in_[kMaxBlockSize];
+  FloatFrame engine_out_[kMaxBlockSize];
   
   int16_t tail_buffer_[2][256];
   
   Parameters parameters_;
+  SnapshotBuffer<Parameters> pending_parameters_;
+  SpscQueue<Command, kCommandQueueSize> commands_;
   
-  SampleRateConverter<-kDownsamplingFactor, 45, src_filter_1x_2_45> src_down_;
-  SampleRateConverter<+kDownsamplingFactor, 45, src_filter_1x_2_45> src_up_;
+  int32_t src_filter_;
+  SampleRateConverter<-kDownsamplingFactor, kMaxSrcFilterSize> src_down_;
+  SampleRateConverter<+kDownsamplingFactor, kMaxSrcFilterSize> src_up_;
+  // Second stage, between 1/2 and 1/4 of the sample rate.
+  SampleRateConverter<-kDownsamplingFactor, kMaxSrcFilterSize> src_down_4_;
+  SampleRateConverter<+kDownsamplingFactor, kMaxSrcFilterSize> src_up_4_;
   
   PersistentState persistent_state_;
   
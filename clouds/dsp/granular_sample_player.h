@@ -35,12 +35,12 @@
 
 #include "stmlib/dsp/atan.h"
 #include "stmlib/dsp/units.h"
-#include "stmlib/utils/random.h"
 
 #include "clouds/dsp/audio_buffer.h"
 #include "clouds/dsp/frame.h"
 #include "clouds/dsp/grain.h"
 #include "clouds/dsp/parameters.h"
+#include "clouds/dsp/random.h"
 
 #include "clouds/resources.h"
 
@@ -55,8 +55,14 @@ class GranularSamplePlayer {
   GranularSamplePlayer() { }
   ~GranularSamplePlayer() { }
   
-  void Init(int32_t num_channels, int32_t max_num_grains) {
+  void Init(
+      RandomGenerator* random,
+      int32_t num_channels,
+      int32_t max_num_grains,
+      float sample_rate) {
+    random_ = random;
     max_num_grains_ = max_num_grains;
+    grain_size_scale_ = sample_rate / kNominalSampleRate;
     num_midfi_grains_ = 3 * max_num_grains / 4;
     gain_normalization_ = 1.0f;
     for (int32_t i = 0; i < kMaxNumGrains; ++i) {
@@ -88,12 +94,14 @@ class GranularSamplePlayer {
     
     // Try to schedule new grains.
     bool seed_trigger = parameters.trigger;
+    size_t trigger_offset = parameters.trigger_offset;
     for (size_t t = 0; t < size; ++t) {
       grain_rate_phasor_ += 1.0f;
-      bool seed_probabilistic = Random::GetFloat() < p
+      bool seed_probabilistic = random_->GetFloat() < p
           && target_num_grains > num_grains_;
       bool seed_deterministic = grain_rate_phasor_ >= space_between_grains;
-      bool seed = seed_probabilistic || seed_deterministic || seed_trigger;
+      bool seed_triggered = seed_trigger && t >= trigger_offset;
+      bool seed = seed_probabilistic || seed_deterministic || seed_triggered;
       if (num_available_grains && seed) {
         --num_available_grains;
         int32_t index = available_grains_[num_available_grains];
@@ -107,13 +115,15 @@ class GranularSamplePlayer {
         Grain* g = &grains_[index];
         ScheduleGrain(
             g,
+            buffer,
             parameters,
             t,
-            buffer->size(),
             buffer->head() - size + t,
             quality);
         grain_rate_phasor_ = 0.0f;
-        seed_trigger = false;
+        if (t >= trigger_offset) {
+          seed_trigger = false;
+        }
       }
     }
     
@@ -175,20 +185,23 @@ class GranularSamplePlayer {
     return num_available_grains;
   }
   
+  template<Resolution resolution>
   void ScheduleGrain(
       Grain* grain,
+      const AudioBuffer<resolution>* buffer,
       const Parameters& parameters,
       int32_t pre_delay,
-      int32_t buffer_size,
       int32_t buffer_head,
       GrainQuality quality) {
+    int32_t buffer_size = buffer->size();
     float position = parameters.position;
     float pitch = parameters.pitch;
     float window_shape = parameters.granular.window_shape;
     float grain_size = Interpolate(lut_grain_size, parameters.size, 256.0f);
+    grain_size *= grain_size_scale_;
     float pitch_ratio = SemitonesToRatio(pitch);
     float inv_pitch_ratio = SemitonesToRatio(-pitch);
-    float pan = 0.5f + parameters.stereo_spread * (Random::GetFloat() - 0.5f);
+    float pan = 0.5f + parameters.stereo_spread * (random_->GetFloat() - 0.5f);
     float gain_l, gain_r;
     if (num_channels_ == 1) {
       gain_l = Interpolate(lut_sin, pan, 256.0f);
@@ -223,6 +236,8 @@ class GranularSamplePlayer {
     int32_t size = static_cast<int32_t>(grain_size) & ~1;
     int32_t start = buffer_head - static_cast<int32_t>(
         position * available + eaten_by_play_head);
+    grain_size_hint_ = grain_size;
+    
     grain->Start(
         pre_delay,
         buffer_size,
@@ -233,10 +248,21 @@ class GranularSamplePlayer {
         window_shape,
         gain_l,
         gain_r,
-        quality);
-    grain_size_hint_ = grain_size;
+        quality,
+        buffer->num_mipmaps());
+    
+    // Don't waste time rendering a grain which would only play silence.
+    int32_t extent = static_cast<int32_t>(eaten_by_play_head);
+    bool silent = buffer[0].Peak(start, extent) == 0;
+    if (num_channels_ == 2) {
+      silent = silent && buffer[1].Peak(start, extent) == 0;
+    }
+    if (silent) {
+      grain->Mute();
+    }
   }
   
+  RandomGenerator* random_;
   int32_t max_num_grains_;
   int32_t num_midfi_grains_;
   int32_t num_channels_;
@@ -244,6 +270,7 @@ class GranularSamplePlayer {
   float num_grains_;
   float gain_normalization_;
   float grain_size_hint_;
+  float grain_size_scale_;
   float grain_rate_phasor_;
   
   Grain grains_[kMaxNumGrains];
@@ -68,6 +68,7 @@ class LoopingSamplePlayer {
     loop_duration_ = 0.0f;
     tap_delay_ = 0;
     tap_delay_counter_ = 0;
+    smoothed_tap_delay_ = 0;
     synchronized_ = false;
     tail_duration_ = 1.0f;
   }
@@ -87,25 +88,36 @@ class LoopingSamplePlayer {
       tap_delay_counter_ = 0;
       synchronized_ = false;
     }
+    // The counter is kept relative to the beginning of the block, so that the
+    // tap delay is measured between the exact trigger positions.
+    int32_t restart = -1;
     if (parameters.trigger) {
-      if(tap_delay_counter_ > 128) {
+      int32_t tap_delay = tap_delay_counter_ + parameters.trigger_offset;
+      if(tap_delay > 128) {
         synchronized_ = true;
-        tap_delay_ = tap_delay_counter_;
-        loop_reset_ = phase_;
-        phase_ = 0.0f;
+        tap_delay_ = tap_delay;
+        restart = parameters.trigger_offset;
       }
-      tap_delay_counter_ = 0;
+      tap_delay_counter_ = -parameters.trigger_offset;
+    }
+    // When not frozen, the playback phase is reset at the end of the block
+    // anyway.
+    if (restart != -1 && !parameters.freeze) {
+      loop_reset_ = phase_;
+      phase_ = 0.0f;
     }
 
     if (synchronized_)
       smoothed_tap_delay_ += 0.01f * (tap_delay_ - smoothed_tap_delay_);
 
-    float target_delay = parameters.position * parameters.position * max_delay;
+    PlaybackPosition target_delay = parameters.position * parameters.position *
+        static_cast<PlaybackPosition>(max_delay);
     if (synchronized_) {
       int index = roundf(parameters.position *
                          static_cast<float>(kMultDivSteps));
       CONSTRAIN(index, 0, kMultDivSteps-1);
-      do target_delay = kMultDivs[index--] * static_cast<float>(smoothed_tap_delay_);
+      do target_delay = kMultDivs[index--] *
+          static_cast<PlaybackPosition>(smoothed_tap_delay_);
       while (target_delay > max_delay && index >= 0);
     }
 
@@ -113,32 +125,38 @@ class LoopingSamplePlayer {
 
     if (!parameters.freeze) {
       while (size--) {
-        float error = (target_delay - current_delay_);
-        float delay = current_delay_ + 0.0005f * error;
+        PlaybackPosition error = (target_delay - current_delay_);
+        PlaybackPosition delay = current_delay_ + 0.0005f * error;
         current_delay_ = delay;
-        int32_t delay_int = (buffer->head() - 4 - size + buffer->size()) << 12;
-        delay_int -= static_cast<int32_t>(delay * 4096.0f);
+        PlaybackPhase delay_int = static_cast<PlaybackPhase>(
+            buffer->head() - 4 - size + buffer->size()) << 12;
+        delay_int -= static_cast<PlaybackPhase>(delay * 4096.0f);
+        int32_t integral = static_cast<int32_t>(delay_int >> 12);
+        uint16_t fractional = static_cast<uint16_t>((delay_int & 0xfff) << 4);
         
-        float l = buffer[0].ReadHermite((delay_int >> 12), delay_int << 4);
+        float l = buffer[0].ReadHermite(integral, fractional);
         if (num_channels_ == 1) {
           *out++ = l;
           *out++ = l;
         } else if (num_channels_ == 2) {
-          float r = buffer[1].ReadHermite((delay_int >> 12), delay_int << 4);
+          float r = buffer[1].ReadHermite(integral, fractional);
           *out++ = l + (r - l) * swap_channels;
           *out++ = r + (l - r) * swap_channels;
         }
       }
       phase_ = 0.0f;
     } else {
-      float loop_point = parameters.position * max_delay * 15.0f / 16.0f;
+      PlaybackPosition loop_point = parameters.position *
+          static_cast<PlaybackPosition>(max_delay) * 15.0f / 16.0f;
       loop_point += kCrossfadeDuration;
       float d = parameters.size;
-      float loop_duration = (0.01f + 0.99f * d * d) * max_delay;
+      PlaybackPosition loop_duration = (0.01f + 0.99f * d * d) *
+          static_cast<PlaybackPosition>(max_delay);
       if (synchronized_) {
         int index = roundf(d * static_cast<float>(kMultDivSteps));
         CONSTRAIN(index, 0, kMultDivSteps-1);
-        do loop_duration = kMultDivs[index--] * static_cast<float>(smoothed_tap_delay_);
+        do loop_duration = kMultDivs[index--] *
+            static_cast<PlaybackPosition>(smoothed_tap_delay_);
         while (loop_duration > max_delay && index >= 0);
       }
       if (loop_point + loop_duration >= max_delay) {
@@ -147,9 +165,23 @@ class LoopingSamplePlayer {
       float phase_increment = synchronized_
           ? 1.0f
           : SemitonesToRatio(parameters.pitch);
+      
+      // When the loop is transposed up by more than an octave, read from a
+      // decimated copy of the buffer.
+      int32_t level = MipmapLevel(
+          static_cast<int32_t>(phase_increment * 65536.0f),
+          buffer->num_mipmaps());
+      const AudioBuffer<resolution>* l_buffer = buffer[0].mipmap(level);
+      const AudioBuffer<resolution>* r_buffer = buffer[
+          num_channels_ - 1].mipmap(level);
 
       while (size--) {
         ONE_POLE(smoothed_tap_delay_, tap_delay_, 0.00001f);
+        
+        if (restart-- == 0) {
+          loop_reset_ = phase_;
+          phase_ = 0.0f;
+        }
 
         if (phase_ >= loop_duration_ || phase_ == 0.0f) {
           if (phase_ >= loop_duration_) {
@@ -170,38 +202,43 @@ class LoopingSamplePlayer {
         
         float gain = 1.0f;
         if (tail_duration_ != 0.0f) {
-          gain = phase_ / tail_duration_;
+          gain = static_cast<float>(phase_ / tail_duration_);
           CONSTRAIN(gain, 0.0f, 1.0f);
         }
-        int32_t delay_int = (buffer->head() - 4 + buffer->size()) << 12;
+        PlaybackPhase delay_int = static_cast<PlaybackPhase>(
+            buffer->head() - 4 + buffer->size()) << 12;
 
-        float ph = parameters.granular.reverse ?
+        PlaybackPosition ph = parameters.granular.reverse ?
           loop_duration_ - phase_ :
           phase_;
 
-        int32_t position = delay_int - static_cast<int32_t>(
-          (loop_duration_ - ph + loop_point_) * 4096.0f);
-        float l = buffer[0].ReadHermite((position >> 12), position << 4);
+        PlaybackPhase position = (delay_int - static_cast<PlaybackPhase>(
+          (loop_duration_ - ph + loop_point_) * 4096.0f)) >> level;
+        int32_t integral = static_cast<int32_t>(position >> 12);
+        uint16_t fractional = static_cast<uint16_t>((position & 0xfff) << 4);
+        float l = l_buffer->ReadHermite(integral, fractional);
         if (num_channels_ == 1) {
           out[0] = l * gain;
           out[1] = l * gain;
         } else if (num_channels_ == 2) {
-          float r = buffer[1].ReadHermite((position >> 12), position << 4);
+          float r = r_buffer->ReadHermite(integral, fractional);
           out[0] = (l + (r - l) * swap_channels) * gain;
           out[1] = (r + (l - r) * swap_channels) * gain;
         }
         
         if (gain != 1.0f) {
           gain = 1.0f - gain;
-          int32_t position = delay_int - static_cast<int32_t>(
-                (-phase_ + tail_start_) * 4096.0f);
+          PlaybackPhase position = (delay_int - static_cast<PlaybackPhase>(
+                (-phase_ + tail_start_) * 4096.0f)) >> level;
+          int32_t integral = static_cast<int32_t>(position >> 12);
+          uint16_t fractional = static_cast<uint16_t>((position & 0xfff) << 4);
         
-          float l = buffer[0].ReadHermite((position >> 12), position << 4);
+          float l = l_buffer->ReadHermite(integral, fractional);
           if (num_channels_ == 1) {
             out[0] += l * gain;
             out[1] += l * gain;
           } else if (num_channels_ == 2) {
-            float r = buffer[1].ReadHermite((position >> 12), position << 4);
+            float r = r_buffer->ReadHermite(integral, fractional);
             out[0] += (l + (r - l) * swap_channels) * gain;
             out[1] += (r + (l - r) * swap_channels) * gain;
           }
@@ -212,14 +249,14 @@ class LoopingSamplePlayer {
   }
   
  private:
-  float phase_;
-  float current_delay_;
-
-  float loop_point_;
-  float loop_duration_;
-  float tail_start_;
-  float tail_duration_;
-  float loop_reset_;
+  PlaybackPosition phase_;
+  PlaybackPosition current_delay_;
+
+  PlaybackPosition loop_point_;
+  PlaybackPosition loop_duration_;
+  PlaybackPosition tail_start_;
+  PlaybackPosition tail_duration_;
+  PlaybackPosition loop_reset_;
 
   bool synchronized_;
   
@@ -48,6 +48,9 @@ struct Parameters {
   bool trigger;
   bool gate;
   
+  // Position of the trigger in the block, in samples.
+  int32_t trigger_offset;
+  
   struct Granular {
     float overlap;
     float window_shape;
@@ -45,7 +45,9 @@ using namespace stmlib;
 void FrameTransformation::Init(
     float* buffer,
     int32_t fft_size,
-    int32_t num_textures) {
+    int32_t num_textures,
+    RandomGenerator* random) {
+  random_ = random;
   fft_size_ = fft_size;
   size_ = (fft_size >> 1) - kHighFrequencyTruncation;
   
@@ -57,13 +59,17 @@ void FrameTransformation::Init(
   phases_delta_ = phases_ + size_;
 
   glitch_algorithm_ = 0;
-  Reset();
+  num_cleared_ = 0;
 }
 
-void FrameTransformation::Reset() {
-  for (int32_t i = 0; i < num_textures_; ++i) {
-    fill(&textures_[i][0], &textures_[i][size_], 0.0f);
-  }
+bool FrameTransformation::ClearSome(size_t num_samples) {
+  // The textures are contiguous. The last one, holding the phases, is not
+  // cleared.
+  size_t size = num_textures_ * size_;
+  size_t end = min(num_cleared_ + num_samples, size);
+  fill(&textures_[0][num_cleared_], &textures_[0][end], 0.0f);
+  num_cleared_ = end;
+  return num_cleared_ == size;
 }
 
 void FrameTransformation::Process(
@@ -98,7 +104,7 @@ void FrameTransformation::Process(
   if (!glitch) {
     // Decide on which glitch algorithm will be used next time... if glitch
     // is enabled on the next frame!
-    glitch_algorithm_ = stmlib::Random::GetSample() & 3;
+    glitch_algorithm_ = random_->GetSample() & 3;
   }
 
   ifft_in[0] = 0.0f;
@@ -133,7 +139,7 @@ void FrameTransformation::SetPhases(
   int32_t amount = static_cast<int32_t>(r * 32768.0f);
   for (int32_t i = 0; i < size_; ++i) {
     synthesis_phase[i] += \
-        static_cast<int32_t>(stmlib::Random::GetSample()) * amount >> 14;
+        static_cast<int32_t>(random_->GetSample()) * amount >> 14;
   }
 }
 
@@ -159,7 +165,7 @@ void FrameTransformation::AddGlitch(float* xf_polar) {
         // Create trails
         float held = 0.0;
         for (int32_t i = 0; i < size_; ++i) {
-          if ((stmlib::Random::GetSample() & 15) == 0) {
+          if ((random_->GetSample() & 15) == 0) {
             held = x[i];
           }
           x[i] = held;
@@ -171,7 +177,7 @@ void FrameTransformation::AddGlitch(float* xf_polar) {
     case 1:
       // Spectral shift up with aliasing.
       {
-        float factor = 1.0f + (stmlib::Random::GetSample() & 7) / 4.0f;
+        float factor = 1.0f + (random_->GetSample() & 7) / 4.0f;
         float source = 0.0f;
         for (int32_t i = 0; i < size_; ++i) {
           source += factor;
@@ -193,7 +199,7 @@ void FrameTransformation::AddGlitch(float* xf_polar) {
       {
         // Nasty high-pass
         for (int32_t i = 0; i < size_; ++i) {
-          uint32_t random = stmlib::Random::GetSample() & 15;
+          uint32_t random = random_->GetSample() & 15;
           if (random == 0) {
             x[i] *= static_cast<float>(i) / 16.0f;
           }
@@ -339,7 +345,7 @@ void FrameTransformation::StoreMagnitudes(
     uint16_t threshold = feedback * 65535.0f;
     for (int32_t i = 0; i < size_; ++i) {
       float x = *xf_polar++;
-      float gain = static_cast<uint16_t>(Random::GetSample()) <= threshold
+      float gain = static_cast<uint16_t>(random_->GetSample()) <= threshold
           ? 1.0f : 0.0f;
       a[i] = Crossfade(a[i], x, gain_a * gain);
       b[i] = Crossfade(b[i], x, gain_b * gain);
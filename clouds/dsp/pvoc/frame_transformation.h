@@ -31,6 +31,7 @@
 
 #include "stmlib/stmlib.h"
 
+#include "clouds/dsp/random.h"
 #include "clouds/dsp/pvoc/stft.h"
 
 #include "clouds/resources.h"
@@ -47,8 +48,15 @@ class FrameTransformation {
   FrameTransformation() { }
   ~FrameTransformation() { }
   
-  void Init(float* buffer, int32_t fft_size, int32_t num_textures);
-  void Reset();
+  void Init(
+      float* buffer,
+      int32_t fft_size,
+      int32_t num_textures,
+      RandomGenerator* random);
+  
+  // The textures are not cleared by Init(): this fills up to num_samples more
+  // samples of them with silence, and returns true once they are all clear.
+  bool ClearSome(size_t num_samples);
   
   void Process(
       const Parameters& parameters,
@@ -82,6 +90,7 @@ class FrameTransformation {
   int32_t fft_size_;
   int32_t num_textures_;
   int32_t size_;
+  size_t num_cleared_;
   
   // Magnitude buffers.
   float* textures_[kMaxNumTextures];
@@ -91,6 +100,7 @@ class FrameTransformation {
   uint16_t* phases_delta_;
 
   int8_t glitch_algorithm_;
+  RandomGenerator* random_;
   
   DISALLOW_COPY_AND_ASSIGN(FrameTransformation);
 };
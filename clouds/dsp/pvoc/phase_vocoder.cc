@@ -44,7 +44,8 @@ void PhaseVocoder::Init(
     size_t largest_fft_size,
     int32_t num_channels,
     int32_t resolution,
-    float sample_rate) {
+    float sample_rate,
+    RandomGenerator* random) {
   num_channels_ = num_channels;
 
   size_t fft_size = largest_fft_size;
@@ -78,8 +79,21 @@ void PhaseVocoder::Init(
   for (int32_t i = 0; i < num_channels_; ++i) {
     float* texture_buffer = allocator[i]->Allocate<float>(
         num_textures * texture_size);
-    frame_transformation_[i].Init(texture_buffer, fft_size, num_textures);
+    frame_transformation_[i].Init(
+        texture_buffer,
+        fft_size,
+        num_textures,
+        random);
+  }
+}
+
+bool PhaseVocoder::ClearSome(size_t num_samples) {
+  bool done = true;
+  for (int32_t i = 0; i < num_channels_; ++i) {
+    done = stft_[i].ClearSome(num_samples) && done;
+    done = frame_transformation_[i].ClearSome(num_samples) && done;
   }
+  return done;
 }
 
 void PhaseVocoder::Process(
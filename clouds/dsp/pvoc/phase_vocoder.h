@@ -51,7 +51,12 @@ class PhaseVocoder {
       const float* large_window_lut, size_t largest_fft_size,
       int32_t num_channels,
       int32_t resolution,
-      float sample_rate);
+      float sample_rate,
+      RandomGenerator* random);
+  
+  // The buffers are not cleared by Init(): this clears up to num_samples more
+  // samples of each of them, and returns true once they are all clear.
+  bool ClearSome(size_t num_samples);
 
   void Process(
       const Parameters& parameters,
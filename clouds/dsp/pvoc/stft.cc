@@ -31,6 +31,7 @@
 #include <algorithm>
 
 #include "clouds/dsp/pvoc/frame_transformation.h"
+#include "clouds/dsp/sample_conversion.h"
 #include "stmlib/dsp/dsp.h"
 
 namespace clouds {
@@ -74,17 +75,20 @@ void STFT::Init(
   
   parameters_ = NULL;
   
-  Reset();
-}
-
-void STFT::Reset() {
   buffer_ptr_ = 0;
   process_ptr_ = (2 * hop_size_) % buffer_size_;
   block_size_ = 0;
-  fill(&analysis_[0], &analysis_[buffer_size_], 0);
-  fill(&synthesis_[0], &synthesis_[buffer_size_], 0);
   ready_ = 0;
   done_ = 0;
+  num_cleared_ = 0;
+}
+
+bool STFT::ClearSome(size_t num_samples) {
+  // The synthesis buffer follows the analysis buffer.
+  size_t end = min(num_cleared_ + num_samples, 2 * buffer_size_);
+  fill(&analysis_[num_cleared_], &analysis_[end], 0);
+  num_cleared_ = end;
+  return num_cleared_ == 2 * buffer_size_;
 }
 
 void STFT::Process(
@@ -96,13 +100,12 @@ void STFT::Process(
   parameters_ = &parameters;
   while (size) {
     size_t processed = min(size, hop_size_ - block_size_);
-    for (size_t i = 0; i < processed; ++i) {
-      int32_t sample = *input * 32768.0f;
-      analysis_[buffer_ptr_ + i] = Clip16(sample);
-      *output = static_cast<float>(synthesis_[buffer_ptr_ + i]) / 16384.0f;
-      input += stride;
-      output += stride;
-    }
+    FloatToShort(
+        input, stride, &analysis_[buffer_ptr_], processed, 32768.0f);
+    ShortToFloat(
+        &synthesis_[buffer_ptr_], output, stride, processed, 1.0f / 16384.0f);
+    input += processed * stride;
+    output += processed * stride;
     
     block_size_ += processed;
     size -= processed;
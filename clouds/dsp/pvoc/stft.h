@@ -59,6 +59,8 @@ class STFT {
   
   struct Frame { short l; short r; };
   
+  // The analysis and synthesis buffers are not cleared here: ClearSome() must
+  // be called until it returns true before anything is processed.
   void Init(
       FFT* fft,
       size_t fft_size,
@@ -69,7 +71,9 @@ class STFT {
       short* stft_frame_processor_buffer,
       Modifier* modifier);
 
-  void Reset();
+  // Fills up to num_samples more samples of the buffers with silence. Returns
+  // true once they are all clear.
+  bool ClearSome(size_t num_samples);
 
   void Process(
       const Parameters& parameters,
@@ -104,6 +108,8 @@ class STFT {
   size_t ready_;
   size_t done_;
   
+  size_t num_cleared_;
+  
   const Parameters* parameters_;
   
   Modifier* modifier_;
@@ -30,9 +30,9 @@
 #define CLOUDS_DSP_RESONESTOR_H_
 
 #include "stmlib/stmlib.h"
-#include "stmlib/utils/random.h"
 #include "stmlib/dsp/units.h"
 #include "clouds/dsp/fx/fx_engine.h"
+#include "clouds/dsp/random.h"
 #include "clouds/resources.h"
 
 using namespace stmlib;
@@ -76,8 +76,18 @@ class Resonestor {
   Resonestor() { }
   ~Resonestor() { }
 
-  void Init(float* buffer) {
-    engine_.Init(buffer);
+  // The memory is then cleared by calls to ClearSome(). sample_rate is the
+  // rate of the host: in low fidelity mode, the Resonestor runs at half that
+  // rate, and sounds an octave lower, as it always did on the module. The
+  // delay lines, and thus the lowest pitch, are stretched by delay_scale.
+  void Init(
+      float* buffer,
+      float sample_rate,
+      float delay_scale,
+      RandomGenerator* random) {
+    sample_rate_ = sample_rate;
+    random_ = random;
+    engine_.Init(buffer, delay_scale);
     for (int v=0; v<2; v++) {
       pitch_[v] = 0.0f;
       chord_[v] = 0.0f;
@@ -94,14 +104,16 @@ class Resonestor {
     burst_comb_ = 1.0f;
     burst_duration_ = 0.0f;
     trigger_ = previous_trigger_ = 0.0f;
+    trigger_offset_ = 0;
+    burst_delay_ = 0;
     freeze_ = previous_freeze_ = 0.0f;
     voice_ = false;
     for (int i=0; i<3; i++)
-      spread_delay_[i] = Random::GetFloat() * 3999;
+      spread_delay_[i] = random_->GetFloat() * 3999 * delay_scale;
     burst_lp_.Init();
     rand_lp_.Init();
     rand_hp_.Init();
-    rand_hp_.set_f<FREQUENCY_FAST>(1.0f / 32000.0f);
+    rand_hp_.set_f<FREQUENCY_FAST>(1.0f / sample_rate_);
     for (int v=0; v<2; v++)
       for (int p=0; p<4; p++) {
         lp_[p][v].Init();
@@ -112,6 +124,15 @@ class Resonestor {
       }
   }
 
+  // Returns true once the memory is all clear.
+  bool ClearSome(size_t num_samples) {
+    return engine_.ClearSome(num_samples);
+  }
+  
+  static size_t memory_size(float delay_scale) {
+    return E::memory_size(delay_scale);
+  }
+
 #define MAX_COMB 1000
 #define BASE_PITCH 261.626f
 
@@ -140,6 +161,8 @@ class Resonestor {
     E::DelayLine<Memory, 9> c21;
     E::DelayLine<Memory, 10> c31;
     E::Context c;
+    const float scale = engine_.scale();
+    const float max_comb = MAX_COMB * scale;
 
     /* switch active voice */
     if (trigger_ && !previous_trigger_ && !freeze_) {
@@ -152,12 +175,12 @@ class Resonestor {
     }
 
     /* set comb filters pitch */
-    comb_period_[0][voice_] = 32000.0f / BASE_PITCH / SemitonesToRatio(pitch_[voice_]);
-    CONSTRAIN(comb_period_[0][voice_], 0, MAX_COMB);
+    comb_period_[0][voice_] = sample_rate_ / BASE_PITCH / SemitonesToRatio(pitch_[voice_]);
+    CONSTRAIN(comb_period_[0][voice_], 0, max_comb);
     for (int p=1; p<4; p++) {
       float pitch = InterpolatePlateau(chords[p-1], chord_[voice_], 16);
       comb_period_[p][voice_] = comb_period_[0][voice_] / SemitonesToRatio(pitch);
-      CONSTRAIN(comb_period_[p][voice_], 0, MAX_COMB);
+      CONSTRAIN(comb_period_[p][voice_], 0, max_comb);
     }
 
     /* set LP/BP filters frequencies and feedback */
@@ -167,17 +190,18 @@ class Resonestor {
       float lp_freq = (2.0f * freq + 1.0f) * damp_[voice_];
       CONSTRAIN(lp_freq, 0.0f, 1.0f);
       lp_[p][voice_].set_f_q<FREQUENCY_FAST>(lp_freq, 0.4f);
-      comb_feedback_[p][voice_] = powf(feedback_[voice_], comb_period_[p][voice_] / 32000.0f);
+      comb_feedback_[p][voice_] = powf(feedback_[voice_], comb_period_[p][voice_] / sample_rate_);
     }
 
     /* initiate burst if trigger */
     if (trigger_ && !previous_trigger_) {
       previous_trigger_ = trigger_;
+      burst_delay_ = trigger_offset_;
       burst_time_ = comb_period_[0][voice_];
       burst_time_ *= 2.0f * burst_duration_;
 
       for (int i=0; i<3; i++)
-        spread_delay_[i] = Random::GetFloat() * (bd0.length - 1);
+        spread_delay_[i] = random_->GetFloat() * (bd0.length - 1) * scale;
     }
 
     rand_lp_.set_f_q<FREQUENCY_FAST>(distortion_[voice_] * 0.4f, 1.0f);
@@ -185,15 +209,20 @@ class Resonestor {
     while (size--) {
       engine_.Start(&c);
 
-      burst_time_--;
-      float burst_gain = burst_time_ > 0.0f ? 1.0f : 0.0f;
+      float burst_gain = 0.0f;
+      if (burst_delay_) {
+        --burst_delay_;
+      } else {
+        burst_time_--;
+        burst_gain = burst_time_ > 0.0f ? 1.0f : 0.0f;
+      }
 
-      float random = Random::GetFloat() * 2.0f - 1.0f;
+      float random = random_->GetFloat() * 2.0f - 1.0f;
       /* burst noise generation */
       c.Read(random, burst_gain);
       // goes through comb and lp filters
       const float comb_fb = 0.6f - burst_comb_ * 0.4f;
-      float comb_del = burst_comb_ * bc.length;
+      float comb_del = burst_comb_ * bc.length * scale;
       if (comb_del <= 1.0f) comb_del = 1.0f;
       c.InterpolateHermite(bc, comb_del, comb_fb);
       c.Write(bc, 1.0f);
@@ -233,7 +262,7 @@ class Resonestor {
         acc = lp_[part][voice].Process<FILTER_MODE_LOW_PASS>(acc);      \
         acc = bp_[part][voice].Process<FILTER_MODE_BAND_PASS_NORMALIZED>(acc); \
         c.Load(acc);                                                    \
-        c.Hp(hp_[part][voice], 10.0f / 32000.0f);                       \
+        c.Hp(hp_[part][voice], 10.0f / sample_rate_);                   \
         c.Write(acc, 0.5f);                                             \
         c.SoftLimit();                                                  \
         c.Write(acc, 2.0f);                                             \
@@ -316,6 +345,11 @@ class Resonestor {
     trigger_ = trigger;
   }
 
+  // Position of the trigger in the block, in samples.
+  void set_trigger_offset(int32_t trigger_offset) {
+    trigger_offset_ = trigger_offset;
+  }
+
   void set_burst_damp(float burst_damp) {
     burst_lp_.set_f_q<FREQUENCY_FAST>(burst_damp * burst_damp * 0.5f, 0.8f);
   }
@@ -353,6 +387,9 @@ class Resonestor {
   typedef FxEngine<16384, FORMAT_32_BIT> E;
   E engine_;
 
+  float sample_rate_;
+  RandomGenerator* random_;
+
   /* parameters: */
   float feedback_[2];
   float pitch_[2];
@@ -369,6 +406,8 @@ class Resonestor {
   float burst_comb_;
   float burst_duration_;
   int16_t trigger_, previous_trigger_;
+  int32_t trigger_offset_;
+  int32_t burst_delay_;
   int16_t freeze_, previous_freeze_;
 
   /* internal states: */
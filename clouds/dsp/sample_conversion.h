@@ -0,0 +1,242 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Conversions between float and 16-bit samples.
+//
+// The contiguous case is vectorized with SSE2 or NEON when available, and
+// uses the saturation and packing instructions of the Cortex-M4 otherwise.
+// All implementations truncate towards zero, like the scalar code they
+// replace.
+
+#ifndef CLOUDS_DSP_SAMPLE_CONVERSION_H_
+#define CLOUDS_DSP_SAMPLE_CONVERSION_H_
+
+#include "stmlib/stmlib.h"
+
+#include "stmlib/dsp/dsp.h"
+
+#include "clouds/dsp/frame.h"
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+  #define CLOUDS_CONVERSION_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define CLOUDS_CONVERSION_NEON
+#elif defined(__ARM_FEATURE_DSP)
+  #define CLOUDS_CONVERSION_M4
+#endif
+
+namespace clouds {
+
+#ifdef CLOUDS_CONVERSION_M4
+
+inline int32_t Saturate16(int32_t x) {
+  int32_t result;
+  __asm ("ssat %0, %1, %2" : "=r" (result) : "I" (16), "r" (x));
+  return result;
+}
+
+inline uint32_t Pack16(int32_t low, int32_t high) {
+  uint32_t result;
+  __asm ("pkhbt %0, %1, %2, lsl #16" : "=r" (result) : "r" (low), "r" (high));
+  return result;
+}
+
+#endif  // CLOUDS_CONVERSION_M4
+
+// Converts size samples read every stride floats to saturated 16-bit samples.
+inline void FloatToShort(
+    const float* in,
+    size_t stride,
+    int16_t* out,
+    size_t size,
+    float scale) {
+  if (stride == 1) {
+#if defined(CLOUDS_CONVERSION_SSE2)
+    const __m128 gain = _mm_set1_ps(scale);
+    for (; size >= 8; size -= 8) {
+      __m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in), gain));
+      __m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(in + 4), gain));
+      _mm_storeu_si128((__m128i*)(out), _mm_packs_epi32(a, b));
+      in += 8;
+      out += 8;
+    }
+#elif defined(CLOUDS_CONVERSION_NEON)
+    for (; size >= 4; size -= 4) {
+      int32x4_t x = vcvtq_s32_f32(vmulq_n_f32(vld1q_f32(in), scale));
+      vst1_s16(out, vqmovn_s32(x));
+      in += 4;
+      out += 4;
+    }
+#endif
+  }
+  while (size--) {
+    *out++ = stmlib::Clip16(static_cast<int32_t>(*in * scale));
+    in += stride;
+  }
+}
+
+// Converts size 16-bit samples to floats, written every stride floats.
+inline void ShortToFloat(
+    const int16_t* in,
+    float* out,
+    size_t stride,
+    size_t size,
+    float scale) {
+  if (stride == 1) {
+#if defined(CLOUDS_CONVERSION_SSE2)
+    const __m128 gain = _mm_set1_ps(scale);
+    for (; size >= 8; size -= 8) {
+      __m128i x = _mm_loadu_si128((const __m128i*)(in));
+      __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+      __m128i b = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+      _mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(a), gain));
+      _mm_storeu_ps(out + 4, _mm_mul_ps(_mm_cvtepi32_ps(b), gain));
+      in += 8;
+      out += 8;
+    }
+#elif defined(CLOUDS_CONVERSION_NEON)
+    for (; size >= 4; size -= 4) {
+      float32x4_t x = vcvtq_f32_s32(vmovl_s16(vld1_s16(in)));
+      vst1q_f32(out, vmulq_n_f32(x, scale));
+      in += 4;
+      out += 4;
+    }
+#endif
+  }
+  while (size--) {
+    *out = static_cast<float>(*in++) * scale;
+    out += stride;
+  }
+}
+
+// Converts 16-bit frames to floats, deinterleaving them into two channels.
+inline void ShortToFloat(
+    const ShortFrame* in,
+    float* l,
+    float* r,
+    size_t size,
+    float scale) {
+#if defined(CLOUDS_CONVERSION_SSE2)
+  const __m128 gain = _mm_set1_ps(scale);
+  for (; size >= 4; size -= 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(in));
+    __m128 a = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+    __m128 b = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+    _mm_storeu_ps(l, _mm_mul_ps(_mm_shuffle_ps(a, b, 0x88), gain));
+    _mm_storeu_ps(r, _mm_mul_ps(_mm_shuffle_ps(a, b, 0xdd), gain));
+    in += 4;
+    l += 4;
+    r += 4;
+  }
+#elif defined(CLOUDS_CONVERSION_NEON)
+  for (; size >= 4; size -= 4) {
+    int16x4x2_t x = vld2_s16(&in->l);
+    vst1q_f32(l, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(x.val[0])), scale));
+    vst1q_f32(r, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(x.val[1])), scale));
+    in += 4;
+    l += 4;
+    r += 4;
+  }
+#endif
+  while (size--) {
+    *l++ = static_cast<float>(in->l) * scale;
+    *r++ = static_cast<float>(in->r) * scale;
+    ++in;
+  }
+}
+
+// Soft-limits two channels and interleaves them into 16-bit frames. This is
+// stmlib::SoftConvert applied to each sample.
+inline void SoftConvert(
+    const float* l,
+    const float* r,
+    ShortFrame* out,
+    size_t size) {
+#if defined(CLOUDS_CONVERSION_SSE2)
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 k27 = _mm_set1_ps(27.0f);
+  const __m128 k9 = _mm_set1_ps(9.0f);
+  const __m128 full_scale = _mm_set1_ps(32768.0f);
+  for (; size >= 4; size -= 4) {
+    __m128i x[2];
+    for (int32_t i = 0; i < 2; ++i) {
+      __m128 s = _mm_mul_ps(_mm_loadu_ps(i ? r : l), half);
+      __m128 s2 = _mm_mul_ps(s, s);
+      __m128 num = _mm_mul_ps(s, _mm_add_ps(k27, s2));
+      __m128 den = _mm_add_ps(k27, _mm_mul_ps(_mm_mul_ps(k9, s), s));
+      x[i] = _mm_cvttps_epi32(_mm_mul_ps(_mm_div_ps(num, den), full_scale));
+    }
+    __m128i a = _mm_unpacklo_epi32(x[0], x[1]);
+    __m128i b = _mm_unpackhi_epi32(x[0], x[1]);
+    _mm_storeu_si128((__m128i*)(out), _mm_packs_epi32(a, b));
+    l += 4;
+    r += 4;
+    out += 4;
+  }
+#elif defined(CLOUDS_CONVERSION_NEON)
+  for (; size >= 4; size -= 4) {
+    int16x4x2_t y;
+    for (int32_t i = 0; i < 2; ++i) {
+      float32x4_t s = vmulq_n_f32(vld1q_f32(i ? r : l), 0.5f);
+      float32x4_t s2 = vmulq_f32(s, s);
+      float32x4_t num = vmulq_f32(s, vaddq_f32(vdupq_n_f32(27.0f), s2));
+      float32x4_t den = vmlaq_n_f32(vdupq_n_f32(27.0f), s2, 9.0f);
+#ifdef __aarch64__
+      float32x4_t limited = vdivq_f32(num, den);
+#else
+      float32x4_t inverse = vrecpeq_f32(den);
+      inverse = vmulq_f32(vrecpsq_f32(den, inverse), inverse);
+      inverse = vmulq_f32(vrecpsq_f32(den, inverse), inverse);
+      float32x4_t limited = vmulq_f32(num, inverse);
+#endif  // __aarch64__
+      y.val[i] = vqmovn_s32(vcvtq_s32_f32(vmulq_n_f32(limited, 32768.0f)));
+    }
+    vst2_s16(&out->l, y);
+    l += 4;
+    r += 4;
+    out += 4;
+  }
+#elif defined(CLOUDS_CONVERSION_M4)
+  for (; size; --size) {
+    int32_t a = Saturate16(static_cast<int32_t>(
+        stmlib::SoftLimit(*l++ * 0.5f) * 32768.0f));
+    int32_t b = Saturate16(static_cast<int32_t>(
+        stmlib::SoftLimit(*r++ * 0.5f) * 32768.0f));
+    *reinterpret_cast<uint32_t*>(out++) = Pack16(a, b);
+  }
+#endif
+  while (size--) {
+    out->l = stmlib::SoftConvert(*l++);
+    out->r = stmlib::SoftConvert(*r++);
+    ++out;
+  }
+}
+
+}  // namespace clouds
+
+#endif  // CLOUDS_DSP_SAMPLE_CONVERSION_H_
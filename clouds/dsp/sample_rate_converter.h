@@ -24,69 +24,193 @@
 //
 // -----------------------------------------------------------------------------
 //
-// Sample rate converter
+// Sample rate converter.
+//
+// Polyphase implementation, with a filter of up to max_filter_size taps chosen
+// at initialization. The filter is split into one set of coefficients
+// per output phase, and the history is a linear buffer of interleaved stereo
+// frames, copied down when full, so that each output is a sum over
+// contiguous frames. With SSE2 or NEON, the left and right channels are
+// computed in the lanes of a vector, along with a second phase (upsampling)
+// or the next output (downsampling) in the other two lanes. Each lane sums
+// its taps in the same order as the scalar code, so the results are the same.
 
 #ifndef CLOUDS_DSP_SAMPLE_RATE_CONVERTER_H_
 #define CLOUDS_DSP_SAMPLE_RATE_CONVERTER_H_
 
 #include "stmlib/stmlib.h"
 
+#include <algorithm>
+
 #include "clouds/dsp/frame.h"
 
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+  #define CLOUDS_SRC_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define CLOUDS_SRC_NEON
+#endif
+
 namespace clouds {
 
-template<int32_t ratio, int32_t filter_size, const float* coefficients>
+template<int32_t ratio, int32_t max_filter_size>
 class SampleRateConverter {
  public:
   SampleRateConverter() { }
   ~SampleRateConverter() { }
  
-  void Init() {
-    for (int32_t i = 0; i < filter_size * 2; ++i) {
-      history_[i].l = history_[i].r = 0.0f;
+  // Also clears the history.
+  void Init(const float* coefficients, int32_t filter_size) {
+    filter_size_ = filter_size;
+    num_taps_ = (filter_size + kNumPhases - 1) / kNumPhases;
+    common_taps_ = filter_size / kNumPhases;
+    for (int32_t p = 0; p < kNumPhases; ++p) {
+      for (int32_t k = 0; k < num_taps_; ++k) {
+        int32_t j = p + k * kNumPhases;
+        coefficients_[p][k] = j < filter_size ? coefficients[j] : 0.0f;
+      }
     }
-    std::copy(&coefficients[0], &coefficients[filter_size], &coefficients_[0]);
-    history_ptr_ = filter_size - 1;
+#if defined(CLOUDS_SRC_SSE2) || defined(CLOUDS_SRC_NEON)
+    for (int32_t k = 0; k < num_taps_; ++k) {
+      for (int32_t lane = 0; lane < 4; ++lane) {
+        lanes_[k][lane] = coefficients_[kNumPhases == 2 ? lane >> 1 : 0][k];
+      }
+    }
+#endif  // CLOUDS_SRC_SSE2 || CLOUDS_SRC_NEON
+    std::fill(&history_[0], &history_[kHistorySize * 2], 0.0f);
+    write_ptr_ = num_taps_ - 1;
   };
 
-  void Process(const FloatFrame* in, FloatFrame* out, size_t input_size) {
-    int32_t history_ptr = history_ptr_;
-    FloatFrame* history = history_;
+  // input_size must be a multiple of the decimation factor.
+  void Process(
+      const float* in_l,
+      const float* in_r,
+      float* out_l,
+      float* out_r,
+      size_t input_size) {
     const float scale = ratio < 0 ? 1.0f : float(ratio);
     while (input_size) {
-      int32_t consumed = ratio < 0 ? -ratio : 1;
-      for (int32_t i = 0; i < consumed; ++i) {
-        history[history_ptr + filter_size] = history[history_ptr] = *in++;
-        --input_size;
-        --history_ptr;
-        if (history_ptr < 0) {
-          history_ptr += filter_size;
+#if defined(CLOUDS_SRC_SSE2) || defined(CLOUDS_SRC_NEON)
+      if (kNumPhases == 1 && input_size >= 2 * kConsumed) {
+        Write(in_l, in_r, 2 * kConsumed);
+        in_l += 2 * kConsumed;
+        in_r += 2 * kConsumed;
+        input_size -= 2 * kConsumed;
+        float y[4];
+        const float* x = &history_[2 * (write_ptr_ - 1)];
+        Convolve(x - 2 * kConsumed, x, y);
+        out_l[0] = y[0] * scale;
+        out_r[0] = y[1] * scale;
+        out_l[1] = y[2] * scale;
+        out_r[1] = y[3] * scale;
+        out_l += 2;
+        out_r += 2;
+        continue;
+      }
+#endif  // CLOUDS_SRC_SSE2 || CLOUDS_SRC_NEON
+      Write(in_l, in_r, kConsumed);
+      in_l += kConsumed;
+      in_r += kConsumed;
+      input_size -= kConsumed;
+      const float* x = &history_[2 * (write_ptr_ - 1)];
+#if defined(CLOUDS_SRC_SSE2) || defined(CLOUDS_SRC_NEON)
+      if (kNumPhases == 2) {
+        float y[4];
+        Convolve(x, x, y);
+        for (int32_t p = 0; p < 2; ++p) {
+          out_l[p] = y[2 * p] * scale;
+          out_r[p] = y[2 * p + 1] * scale;
         }
+        out_l += 2;
+        out_r += 2;
+        continue;
       }
-    
-      int32_t produced = ratio > 0 ? ratio : 1;
-      for (int32_t i = 0; i < produced; ++i) {
+#endif  // CLOUDS_SRC_SSE2 || CLOUDS_SRC_NEON
+      for (int32_t p = 0; p < kNumPhases; ++p) {
+        const float* h = coefficients_[p];
+        const float* x_p = x;
         float y_l = 0.0f;
         float y_r = 0.0f;
-        const FloatFrame* x = &history[history_ptr + 1];
-        for (int32_t j = i; j < filter_size; j += produced) {
-          const float h = coefficients_[j];
-          y_l += x->l * h;
-          y_r += x->r * h;
-          ++x;
+        for (int32_t k = 0; k < num_taps(p); ++k) {
+          y_l += x_p[0] * h[k];
+          y_r += x_p[1] * h[k];
+          x_p -= 2;
         }
-        out->l = y_l * scale;
-        out->r = y_r * scale;
-        ++out;
+        *out_l++ = y_l * scale;
+        *out_r++ = y_r * scale;
       }
     }
-    history_ptr_ = history_ptr;
   }
  
  private:
-  float coefficients_[filter_size];
-  FloatFrame history_[filter_size * 2];
-  int32_t history_ptr_;
+  enum {
+    kNumPhases = ratio > 0 ? ratio : 1,
+    kConsumed = ratio < 0 ? -ratio : 1,
+    kMaxNumTaps = (max_filter_size + kNumPhases - 1) / kNumPhases,
+    kHistorySize = kMaxNumTaps - 1 + 2 * kMaxBlockSize
+  };
+  
+  inline int32_t num_taps(int32_t phase) const {
+    return (filter_size_ - phase + kNumPhases - 1) / kNumPhases;
+  }
+  
+  inline void Write(const float* in_l, const float* in_r, int32_t size) {
+    if (write_ptr_ + size > kHistorySize) {
+      std::copy(
+          &history_[2 * (write_ptr_ - num_taps_ + 1)],
+          &history_[2 * write_ptr_],
+          &history_[0]);
+      write_ptr_ = num_taps_ - 1;
+    }
+    float* h = &history_[2 * write_ptr_];
+    for (int32_t i = 0; i < size; ++i) {
+      *h++ = in_l[i];
+      *h++ = in_r[i];
+    }
+    write_ptr_ += size;
+  }
+  
+#if defined(CLOUDS_SRC_SSE2) || defined(CLOUDS_SRC_NEON)
+  // Lanes 0-1: L/R of the frames ending at a, lanes 2-3: ending at b.
+  inline void Convolve(const float* a, const float* b, float* y) const {
+#if defined(CLOUDS_SRC_SSE2)
+    __m128 sum = _mm_setzero_ps();
+    for (int32_t k = 0; k < common_taps_; ++k) {
+      __m128 x = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*) (a - 2 * k));
+      x = _mm_loadh_pi(x, (const __m64*) (b - 2 * k));
+      sum = _mm_add_ps(sum, _mm_mul_ps(x, _mm_loadu_ps(lanes_[k])));
+    }
+    _mm_storeu_ps(y, sum);
+#else
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    for (int32_t k = 0; k < common_taps_; ++k) {
+      float32x4_t x = vcombine_f32(vld1_f32(a - 2 * k), vld1_f32(b - 2 * k));
+      sum = vaddq_f32(sum, vmulq_f32(x, vld1q_f32(lanes_[k])));
+    }
+    vst1q_f32(y, sum);
+#endif  // CLOUDS_SRC_SSE2
+    // The extra tap of the first phase, when upsampling with an odd number of
+    // taps.
+    for (int32_t k = common_taps_; k < num_taps(0); ++k) {
+      y[0] += a[-2 * k] * lanes_[k][0];
+      y[1] += a[-2 * k + 1] * lanes_[k][1];
+    }
+  }
+#endif  // CLOUDS_SRC_SSE2 || CLOUDS_SRC_NEON
+ 
+  int32_t filter_size_;
+  int32_t num_taps_;
+  // Taps shared by all phases - the first phases may have one more.
+  int32_t common_taps_;
+  
+  float coefficients_[kNumPhases][kMaxNumTaps];
+#if defined(CLOUDS_SRC_SSE2) || defined(CLOUDS_SRC_NEON)
+  // Coefficients in the order of the vector lanes, one row per tap.
+  float lanes_[kMaxNumTaps][4];
+#endif  // CLOUDS_SRC_SSE2 || CLOUDS_SRC_NEON
+  float history_[kHistorySize * 2];
+  int32_t write_ptr_;
 
   DISALLOW_COPY_AND_ASSIGN(SampleRateConverter);
 };
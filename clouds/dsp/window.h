@@ -54,20 +54,24 @@ class Window {
     done_ = true;
     regenerated_ = false;
     half_ = false;
+    mipmap_level_ = 0;
   }
   
   void Start(
       int32_t buffer_size,
       int32_t start,
       int32_t width,
-      int32_t phase_increment) {
-    first_sample_ = (start + buffer_size) % buffer_size;
-    phase_increment_ = phase_increment;
+      int32_t phase_increment,
+      int32_t num_mipmaps) {
+    mipmap_level_ = MipmapLevel(phase_increment, num_mipmaps);
+    first_sample_ = ((start + buffer_size) % buffer_size) >> mipmap_level_;
+    phase_increment_ = phase_increment >> mipmap_level_;
     phase_ = 0;
     done_ = false;
     regenerated_ = false;
     done_ = false;
-    envelope_phase_increment_ = 2.0f / static_cast<float>(width);
+    envelope_phase_increment_ = static_cast<float>(1 << mipmap_level_) *
+        2.0f / static_cast<float>(width);
   }
   
   template<Resolution resolution>
@@ -79,7 +83,7 @@ class Window {
     if (done_) {
       return;
     }
-    int32_t phase_integral = phase_ >> 16;
+    int32_t phase_integral = static_cast<int32_t>(phase_ >> 16);
     int32_t phase_fractional = phase_ & 0xffff;
     int32_t sample_index = first_sample_ + phase_integral;
     
@@ -90,12 +94,15 @@ class Window {
         ? 2.0f - envelope_phase
         : envelope_phase;
     
-    float l = buffer[0].ReadHermite(sample_index, phase_fractional) * gain;
+    const AudioBuffer<resolution>* l_buffer = buffer[0].mipmap(mipmap_level_);
+    const AudioBuffer<resolution>* r_buffer = buffer[
+        channels - 1].mipmap(mipmap_level_);
+    float l = l_buffer->ReadHermite(sample_index, phase_fractional) * gain;
     if (channels == 1) {
       *samples++ += l;
       *samples++ += l;
     } else if (channels == 2) {
-      float r = buffer[1].ReadHermite(sample_index, phase_fractional) * gain;
+      float r = r_buffer->ReadHermite(sample_index, phase_fractional) * gain;
       *samples++ += l + (r - l) * swap_channels;
       *samples++ += r + (l - r) * swap_channels;
     }
@@ -109,8 +116,9 @@ class Window {
  private:
   Window* next_;
   int32_t first_sample_;
-  int32_t phase_;
-  int32_t phase_increment_;
+  int32_t mipmap_level_;
+  PlaybackPhase phase_;
+  PlaybackPhase phase_increment_;
   float envelope_phase_increment_;
   
   bool done_;
@@ -98,11 +98,12 @@ class WSOLASamplePlayer {
       synchronized_ = false;
     }
     if (parameters.trigger && !parameters.freeze) {
-      if(tap_delay_counter_ > 128) {
+      int32_t tap_delay = tap_delay_counter_ + parameters.trigger_offset;
+      if(tap_delay > 128) {
         synchronized_ = true;
-        tap_delay_ = tap_delay_counter_;
+        tap_delay_ = tap_delay;
       }
-      tap_delay_counter_ = 0;
+      tap_delay_counter_ = -parameters.trigger_offset;
     }
 
     env_phase_ += env_phase_increment_;
@@ -148,7 +149,7 @@ class WSOLASamplePlayer {
       int32_t source,
       int32_t size,
       uint32_t* destination) {
-    int32_t phase = 0;
+    PlaybackPhase phase = 0;
     uint32_t bits = 0;
     uint32_t bit_counter = 0;
     int32_t num_samples = 0;
@@ -156,8 +157,8 @@ class WSOLASamplePlayer {
       source += buffer->size();
     }
     while ((phase >> 16) < size) {
-      int32_t integral = source + (phase >> 16);
-      uint16_t fractional = phase & 0xffff;
+      int32_t integral = source + static_cast<int32_t>(phase >> 16);
+      uint16_t fractional = static_cast<uint16_t>(phase & 0xffff);
       float s = buffer[0].ReadLinear(integral, fractional);
       if (num_channels == 2) {
         s += buffer[1].ReadLinear(integral, fractional);
@@ -241,7 +242,8 @@ class WSOLASamplePlayer {
         buffer->size(),
         next_window_position - (window_size_ >> 1),
         window_size_,
-        static_cast<uint32_t>(next_pitch_ratio_ * 65536.0f));
+        static_cast<uint32_t>(next_pitch_ratio_ * 65536.0f),
+        buffer->num_mipmaps());
     
     float pitch_error = pitch_ - smoothed_pitch_;
     float pitch_error_sign = pitch_error < 0.0f ? -1.0 : 1.0;
@@ -270,12 +272,14 @@ class WSOLASamplePlayer {
       limit = 0;
     }
     
-    float position = limit * position_;
+    PlaybackPosition position = static_cast<PlaybackPosition>(limit) *
+        position_;
 
     if (synchronized_) {
       int index = roundf(position_ * static_cast<float>(kMultDivSteps));
       CONSTRAIN(index, 0, kMultDivSteps-1);
-      do position = kMultDivs[index--] * static_cast<float>(tap_delay_);
+      do position = kMultDivs[index--] *
+          static_cast<PlaybackPosition>(tap_delay_);
       while (position > limit && index >= 0);
       /* to compensate partially for the size of the windows.
        * TODO: this is still not completely right... */
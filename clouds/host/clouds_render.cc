@@ -0,0 +1,318 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline batch renderer: processes many WAV files with the same settings and
+// automation script, in parallel, with one processor per file.
+//
+// Usage: clouds_render [-j jobs] [-p] [-s script] [-o directory] input.wav...
+//
+// Each input is rendered to <directory>/<name>.clouds.wav, at the sample rate
+// of the input file. With an engine_rate statement in the script, the engine
+// runs at that rate instead, and the output is realigned with the input.
+//
+// With -p, the post-processing of each file runs on a thread of its own - see
+// PipelinedProcessor. This makes the feedback path one block longer.
+//
+// clouds_render_long is the same tool built with CLOUDS_LONG_BUFFER, with 64
+// times as much sample memory.
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/host/pipelined_processor.h"
+#include "clouds/host/render_script.h"
+#include "clouds/host/resampling_processor.h"
+#include "clouds/host/wav_file.h"
+
+using namespace clouds;
+using namespace std;
+
+#ifdef CLOUDS_LONG_BUFFER
+// 64 times the sample memory of the firmware - over a minute of stereo at
+// 32kHz. The workspace of the effects is carved from the large buffer too.
+const size_t kSmallBufferSize = 64 * (65536 - 128);
+const size_t kLargeBufferSize = 2 * kSmallBufferSize;
+#else
+// Same sample memory as the firmware.
+const size_t kLargeBufferSize = 118784;
+const size_t kSmallBufferSize = 65536 - 128;
+#endif  // CLOUDS_LONG_BUFFER
+
+// Number of frames read, processed and written at once.
+const size_t kRenderBlockSize = 1024;
+
+struct Job {
+  const char* input;
+  string output;
+  bool success;
+};
+
+struct Batch {
+  const RenderScript* script;
+  bool pipelined;
+  vector<Job>* jobs;
+  size_t next_job;
+};
+
+bool Render(const RenderScript& script, bool pipelined, const Job& job) {
+  WavReader reader;
+  if (!reader.Open(job.input)) {
+    fprintf(stderr, "%s: %s\n", job.input, reader.error());
+    return false;
+  }
+  WavWriter writer;
+  if (!writer.Open(job.output.c_str(), reader.sample_rate())) {
+    fprintf(stderr, "%s: cannot create file\n", job.output.c_str());
+    return false;
+  }
+  
+  vector<uint8_t> large_buffer(kLargeBufferSize);
+  vector<uint8_t> small_buffer(kSmallBufferSize);
+  GranularProcessor* processor = new GranularProcessor;
+  processor->Init(
+      &large_buffer[0], kLargeBufferSize,
+      &small_buffer[0], kSmallBufferSize);
+  processor->set_sample_rate(reader.sample_rate());
+  ResamplingProcessor* resampler = NULL;
+  int32_t engine_rate = script.engine_rate();
+  if (engine_rate && engine_rate != reader.sample_rate()) {
+    resampler = new ResamplingProcessor;
+    if (!resampler->Init(processor, reader.sample_rate(), engine_rate)) {
+      fprintf(stderr, "%s: cannot convert %d Hz to %d Hz\n",
+          job.input, reader.sample_rate(), engine_rate);
+      delete resampler;
+      delete processor;
+      return false;
+    }
+  }
+  PipelinedProcessor* pipeline = NULL;
+  if (pipelined) {
+    // The resampler drives the processor itself.
+    pipeline = resampler ? NULL : new PipelinedProcessor;
+    if (!pipeline || !pipeline->Init(processor)) {
+      fprintf(stderr, "%s: cannot pipeline the processor\n", job.input);
+      delete pipeline;
+      delete resampler;
+      delete processor;
+      return false;
+    }
+  }
+  processor->set_quality(script.quality());
+  processor->set_src_filter(script.src_filter());
+  processor->set_playback_mode(script.playback_mode());
+  processor->Seed(script.seed());
+  
+  SetDefaultKnobs(processor->mutable_parameters());
+  
+  do {
+    processor->Prepare();
+  } while (!processor->ready());
+  
+  float sample_rate = reader.sample_rate();
+  // Output frames dropped to compensate for the latency of the resamplers,
+  // or of the pipeline.
+  size_t skip = 0;
+  if (resampler) {
+    skip = static_cast<size_t>(resampler->latency() + 0.5f);
+  } else if (pipeline) {
+    skip = pipeline->latency();
+  }
+  size_t num_frames = reader.num_frames() + static_cast<size_t>(
+      script.tail() * sample_rate) + skip;
+  // The tail is rounded up to whole engine blocks, which the engine processes
+  // without extra latency.
+  num_frames = (num_frames + kMaxBlockSize - 1) & ~(kMaxBlockSize - 1);
+  ShortFrame input[kRenderBlockSize];
+  ShortFrame output[kRenderBlockSize];
+  vector<AutomationEvent> events;
+  bool success = true;
+  for (size_t start = 0; start < num_frames && success; ) {
+    size_t size = min(num_frames - start, kRenderBlockSize);
+    // Full blocks of 16-bit stereo files are processed straight from the
+    // mapped file.
+    ShortFrame* in;
+    size_t num_read = reader.Read(input, size, &in);
+    if (num_read < size) {
+      if (in != input) {
+        copy(&in[0], &in[num_read], &input[0]);
+      }
+      fill(&input[num_read].l, &input[0].l + 2 * size, 0);
+      in = input;
+    }
+    
+    events.clear();
+    script.GetEvents(start, size, sample_rate, &events);
+    if (resampler) {
+      resampler->Process(
+          in, output, size,
+          events.empty() ? NULL : &events[0], events.size());
+    } else if (pipeline) {
+      pipeline->Process(
+          in, output, size,
+          events.empty() ? NULL : &events[0], events.size());
+      pipeline->Prepare();
+    } else {
+      processor->Process(
+          in, output, size,
+          events.empty() ? NULL : &events[0], events.size());
+      processor->Prepare();
+    }
+    size_t skipped = min(skip, size);
+    success = writer.Write(output + skipped, size - skipped);
+    skip -= skipped;
+    start += size;
+  }
+  if (pipeline) {
+    pipeline->Stop();
+    delete pipeline;
+  }
+  delete resampler;
+  delete processor;
+  
+  success = writer.Close() && success;
+  if (!success) {
+    fprintf(stderr, "%s: write error\n", job.output.c_str());
+  }
+  return success;
+}
+
+void* Worker(void* arg) {
+#ifdef __SSE__
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+#endif  // __SSE__
+  Batch* batch = static_cast<Batch*>(arg);
+  while (true) {
+    size_t i = __atomic_fetch_add(&batch->next_job, 1, __ATOMIC_RELAXED);
+    if (i >= batch->jobs->size()) {
+      break;
+    }
+    Job* job = &(*batch->jobs)[i];
+    job->success = Render(*batch->script, batch->pipelined, *job);
+    if (job->success) {
+      fprintf(stderr, "%s -> %s\n", job->input, job->output.c_str());
+    }
+  }
+  return NULL;
+}
+
+string OutputFileName(const char* directory, const char* input) {
+  const char* name = strrchr(input, '/');
+  name = name ? name + 1 : input;
+  const char* extension = strrchr(name, '.');
+  string output(directory);
+  output += '/';
+  output.append(name, extension ? extension - name : strlen(name));
+  output += ".clouds.wav";
+  return output;
+}
+
+void Usage() {
+  fprintf(stderr,
+      "usage: clouds_render [-j jobs] [-p] [-s script] [-o directory] "
+      "input.wav...\n");
+}
+
+int main(int argc, char** argv) {
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* script_file_name = NULL;
+  const char* output_directory = ".";
+  bool pipelined = false;
+  
+  int option;
+  while ((option = getopt(argc, argv, "j:ps:o:h")) != -1) {
+    switch (option) {
+      case 'j':
+        num_threads = atol(optarg);
+        break;
+      case 'p':
+        pipelined = true;
+        break;
+      case 's':
+        script_file_name = optarg;
+        break;
+      case 'o':
+        output_directory = optarg;
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if (optind == argc) {
+    Usage();
+    return 1;
+  }
+  
+  RenderScript script;
+  script.Init();
+  if (script_file_name && !script.Load(script_file_name)) {
+    return 1;
+  }
+  
+  vector<Job> jobs(argc - optind);
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    jobs[i].input = argv[optind + i];
+    jobs[i].output = OutputFileName(output_directory, jobs[i].input);
+    jobs[i].success = false;
+  }
+  
+  Batch batch = { &script, pipelined, &jobs, 0 };
+  if (num_threads < 1) {
+    num_threads = 1;
+  } else if (static_cast<size_t>(num_threads) > jobs.size()) {
+    num_threads = jobs.size();
+  }
+  vector<pthread_t> threads(num_threads);
+  long num_started = 0;
+  for (; num_started < num_threads; ++num_started) {
+    if (pthread_create(&threads[num_started], NULL, &Worker, &batch)) {
+      break;
+    }
+  }
+  if (!num_started) {
+    Worker(&batch);
+  }
+  for (long i = 0; i < num_started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  
+  int num_failed = 0;
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    num_failed += jobs[i].success ? 0 : 1;
+  }
+  return num_failed ? 1 : 0;
+}
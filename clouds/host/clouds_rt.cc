@@ -0,0 +1,304 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Real-time soak test: a GranularProcessor driven by the loopback codec, at
+// wall-clock rate, from a SCHED_FIFO thread when the system allows it.
+//
+// Usage: clouds_rt [-b block] [-d seconds] [-r rate] [-p priority]
+//                  [-s script] [-o output.wav] [input.wav]
+//
+// The input file is looped; without one, the processor gets silence at the
+// rate given by -r. Block sizes which are not a multiple of the 32 frames of
+// an engine block add a block of latency. The mode, quality and automation
+// come from the script, as in clouds_render. The load and xruns are printed
+// every second, and the histogram of the callback durations at the end. Exits
+// with status 2 if there was any xrun.
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/host/loopback_codec.h"
+#include "clouds/host/render_script.h"
+#include "clouds/host/wav_file.h"
+
+using namespace clouds;
+using namespace std;
+
+// Same sample memory as the firmware.
+const size_t kLargeBufferSize = 118784;
+const size_t kSmallBufferSize = 65536 - 128;
+
+const size_t kRingSize = 1 << 15;
+const size_t kTransferSize = 4096;
+
+GranularProcessor processor;
+uint8_t large_buffer[kLargeBufferSize];
+uint8_t small_buffer[kSmallBufferSize];
+
+RenderScript script;
+vector<AutomationEvent> events;
+float sample_rate;
+size_t frame_counter;
+
+void FillBuffer(ShortFrame* input, ShortFrame* output, size_t n) {
+  events.clear();
+  script.GetEvents(frame_counter, n, sample_rate, &events);
+  processor.Process(
+      input, output, n,
+      events.empty() ? NULL : &events[0], events.size());
+  // On the module, Prepare() runs in the main loop, between interrupts. It is
+  // accounted for here since it has to fit in the same time budget.
+  processor.Prepare();
+  frame_counter += n;
+}
+
+// Tops up the input ring from the (looped) input.
+void Feed(const vector<ShortFrame>& input, size_t* position, FrameRing* rx) {
+  while (rx->writable()) {
+    size_t size = min(rx->writable(), input.size() - *position);
+    *position += rx->Write(&input[*position], size);
+    if (*position == input.size()) {
+      *position = 0;
+    }
+  }
+}
+
+bool Drain(FrameRing* tx, WavWriter* writer) {
+  ShortFrame frames[kTransferSize];
+  bool success = true;
+  while (size_t size = tx->Read(frames, kTransferSize)) {
+    success = writer->Write(frames, size) && success;
+  }
+  return success;
+}
+
+void PrintStatus(
+    int32_t time,
+    const LoopbackStats& s,
+    const LoopbackStats& previous,
+    int64_t period) {
+  double elapsed = static_cast<double>(s.num_periods - previous.num_periods) *
+      period;
+  double load = elapsed > 0.0
+      ? (s.callback_time - previous.callback_time) / elapsed
+      : 0.0;
+  printf("%5ds  load %5.1f%% (peak %5.1f%%)  xruns %u (%u lost)  "
+         "underruns %u  overruns %u  wake-up delay %.0f us\n",
+         time,
+         100.0 * load,
+         100.0 * s.max_callback_time / period,
+         s.num_missed_deadlines,
+         s.num_lost_periods,
+         s.num_underruns,
+         s.num_overruns,
+         s.max_wake_up_delay / 1000.0);
+  fflush(stdout);
+}
+
+void PrintHistogram(const LoopbackStats& s) {
+  uint32_t peak = *max_element(
+      &s.load_histogram[0], &s.load_histogram[kLoadHistogramSize]);
+  printf("\ncallback duration, in %% of the period:\n");
+  for (int32_t i = 0; i < kLoadHistogramSize; ++i) {
+    uint32_t count = s.load_histogram[i];
+    if (!count) {
+      continue;
+    }
+    int32_t low = 100 * i / kLoadHistogramResolution;
+    int32_t high = 100 * (i + 1) / kLoadHistogramResolution;
+    if (i == kLoadHistogramSize - 1) {
+      printf("  %3d%% and more ", low);
+    } else {
+      printf("  %3d%% - %3d%%   ", low, high);
+    }
+    printf("%10u  ", count);
+    for (uint32_t j = 0; j < 50 * count / peak; ++j) {
+      putchar('#');
+    }
+    putchar('\n');
+  }
+}
+
+void Usage() {
+  fprintf(stderr,
+      "usage: clouds_rt [-b block] [-d seconds] [-r rate] [-p priority]\n"
+      "                 [-s script] [-o output.wav] [input.wav]\n");
+}
+
+int main(int argc, char** argv) {
+  size_t block_size = 32;
+  int32_t duration = 10;
+  sample_rate = 32000.0f;
+  int32_t priority = 80;
+  const char* script_file_name = NULL;
+  const char* output_file_name = NULL;
+  
+  int option;
+  while ((option = getopt(argc, argv, "b:d:r:p:s:o:h")) != -1) {
+    switch (option) {
+      case 'b':
+        block_size = atol(optarg);
+        break;
+      case 'd':
+        duration = atol(optarg);
+        break;
+      case 'r':
+        sample_rate = atof(optarg);
+        break;
+      case 'p':
+        priority = atol(optarg);
+        break;
+      case 's':
+        script_file_name = optarg;
+        break;
+      case 'o':
+        output_file_name = optarg;
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if (argc - optind > 1 || block_size < 1 ||
+      block_size > kMaxCodecBlockSize || sample_rate <= 0.0f) {
+    Usage();
+    return 1;
+  }
+  
+  script.Init();
+  if (script_file_name && !script.Load(script_file_name)) {
+    return 1;
+  }
+  
+  vector<ShortFrame> input;
+  if (optind < argc) {
+    WavReader reader;
+    if (!reader.Open(argv[optind])) {
+      fprintf(stderr, "%s: %s\n", argv[optind], reader.error());
+      return 1;
+    }
+    input.resize(reader.num_frames());
+    if (!input.empty()) {
+      input.resize(reader.Read(&input[0], input.size()));
+    }
+    if (input.empty()) {
+      fprintf(stderr, "%s: no audio data\n", argv[optind]);
+      return 1;
+    }
+    sample_rate = reader.sample_rate();
+  }
+  
+  WavWriter writer;
+  if (output_file_name && !writer.Open(output_file_name, sample_rate)) {
+    fprintf(stderr, "%s: cannot create file\n", output_file_name);
+    return 1;
+  }
+  
+  // Page faults in the codec thread would show up as xruns.
+  if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    fprintf(stderr, "warning: cannot lock memory\n");
+  }
+  
+  processor.Init(
+      &large_buffer[0], kLargeBufferSize,
+      &small_buffer[0], kSmallBufferSize);
+  processor.set_sample_rate(sample_rate);
+  processor.set_quality(script.quality());
+  processor.set_src_filter(script.src_filter());
+  processor.set_playback_mode(script.playback_mode());
+  processor.Seed(script.seed());
+  SetDefaultKnobs(processor.mutable_parameters());
+  do {
+    processor.Prepare();
+  } while (!processor.ready());
+  // At most one knob event per kMaxBlockSize frames, and a few triggers.
+  events.reserve((block_size / kMaxBlockSize + 1) * AUTOMATION_TRIGGER + 64);
+  frame_counter = 0;
+  
+  FrameRing rx;
+  FrameRing tx;
+  size_t position = 0;
+  if (!input.empty()) {
+    rx.Init(kRingSize);
+    Feed(input, &position, &rx);
+  }
+  if (output_file_name) {
+    tx.Init(kRingSize);
+  }
+  
+  LoopbackCodec codec;
+  codec.Init(
+      sample_rate,
+      input.empty() ? NULL : &rx,
+      output_file_name ? &tx : NULL);
+  if (!codec.Start(block_size, &FillBuffer, priority)) {
+    fprintf(stderr, "cannot start the codec thread\n");
+    return 1;
+  }
+  printf("%s thread, %d Hz, %zu frames per period (%.3f ms)\n",
+         codec.real_time() ? "SCHED_FIFO" : "normal (no real-time priority)",
+         static_cast<int32_t>(sample_rate),
+         block_size,
+         codec.period() / 1000000.0);
+  
+  LoopbackStats previous = codec.stats();
+  bool success = true;
+  for (int32_t time = 1; time <= duration; ++time) {
+    for (int32_t i = 0; i < 100; ++i) {
+      usleep(10000);
+      if (!input.empty()) {
+        Feed(input, &position, &rx);
+      }
+      if (output_file_name) {
+        success = Drain(&tx, &writer) && success;
+      }
+    }
+    const LoopbackStats& s = codec.stats();
+    PrintStatus(time, s, previous, codec.period());
+    previous = s;
+  }
+  codec.Stop();
+  
+  if (output_file_name) {
+    success = Drain(&tx, &writer) && success;
+    success = writer.Close() && success;
+    if (!success) {
+      fprintf(stderr, "%s: write error\n", output_file_name);
+      return 1;
+    }
+  }
+  
+  const LoopbackStats& s = codec.stats();
+  PrintHistogram(s);
+  bool xrun = s.num_missed_deadlines || s.num_underruns || s.num_overruns;
+  return xrun ? 2 : 0;
+}
@@ -0,0 +1,436 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Parameter sweep renderer: renders one input file through a grid, or a Latin
+// hypercube sample, of knob settings and modes, in parallel.
+//
+// Usage: clouds_sweep [-j jobs] [-m modes] [-q quality] [-f taps] [-r seed]
+//                     [-t tail] [-l points] [-c] [-o directory]
+//                     -p knob=values... input.wav
+//
+// -m takes a comma-separated list of modes, -f sets the length of the low
+// fidelity resampling filter (31, 45, 63 or 91 taps), -p is repeated for each swept knob
+// (see parameter_sweep.h) and -l renders this number of points of a Latin
+// hypercube instead of the full grid. Each point is rendered to
+// <directory>/<name>.<point>.wav or, with -c, to a pair of channels of
+// <directory>/<name>.sweep.wav. The points are listed in
+// <directory>/<name>.sweep.txt.
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/host/parameter_sweep.h"
+#include "clouds/host/render_script.h"
+#include "clouds/host/wav_file.h"
+
+using namespace clouds;
+using namespace std;
+
+// Same sample memory as the firmware.
+const size_t kLargeBufferSize = 118784;
+const size_t kSmallBufferSize = 65536 - 128;
+
+// Number of frames processed at once.
+const size_t kRenderBlockSize = 1024;
+
+struct Sweep {
+  const ParameterSweep* parameter_sweep;
+  const vector<SweepPoint>* points;
+  
+  // Decoded once, and shared by all workers.
+  const vector<ShortFrame>* input;
+  int32_t sample_rate;
+  
+  int32_t quality;
+  int32_t src_filter;
+  uint32_t seed;
+  size_t num_frames;
+  
+  // Output files, or buffers when all points go to a single file.
+  vector<string>* file_names;
+  vector<vector<ShortFrame> >* rendered;
+  
+  size_t next_point;
+  int32_t num_failed;
+};
+
+bool RenderPoint(
+    const Sweep& sweep,
+    size_t index,
+    GranularProcessor* processor,
+    void* large_buffer,
+    void* small_buffer) {
+  const SweepPoint& point = (*sweep.points)[index];
+  const vector<ShortFrame>& input = *sweep.input;
+  
+  processor->Init(
+      large_buffer, kLargeBufferSize,
+      small_buffer, kSmallBufferSize);
+  processor->set_sample_rate(sweep.sample_rate);
+  processor->set_quality(sweep.quality);
+  processor->set_src_filter(sweep.src_filter);
+  processor->set_playback_mode(point.playback_mode);
+  processor->Seed(sweep.seed);
+  SetDefaultKnobs(processor->mutable_parameters());
+  do {
+    processor->Prepare();
+  } while (!processor->ready());
+  
+  vector<AutomationEvent> events;
+  sweep.parameter_sweep->GetEvents(point, &events);
+  
+  WavWriter writer;
+  ShortFrame* destination = NULL;
+  if (sweep.rendered) {
+    (*sweep.rendered)[index].resize(sweep.num_frames);
+    destination = &(*sweep.rendered)[index][0];
+  } else if (!writer.Open(
+      (*sweep.file_names)[index].c_str(), sweep.sample_rate)) {
+    fprintf(stderr, "%s: cannot create file\n",
+        (*sweep.file_names)[index].c_str());
+    return false;
+  }
+  
+  ShortFrame in[kRenderBlockSize];
+  ShortFrame out[kRenderBlockSize];
+  bool success = true;
+  for (size_t start = 0; start < sweep.num_frames && success; ) {
+    size_t size = min(sweep.num_frames - start, kRenderBlockSize);
+    size_t num_input = start < input.size()
+        ? min(input.size() - start, size)
+        : 0;
+    if (num_input) {
+      copy(&input[start], &input[start] + num_input, &in[0]);
+    }
+    fill(&in[num_input].l, &in[size].l, 0);
+    
+    // The knobs are moved before the first block.
+    processor->Process(
+        in, destination ? destination : out, size,
+        start || events.empty() ? NULL : &events[0],
+        start ? 0 : events.size());
+    processor->Prepare();
+    if (destination) {
+      destination += size;
+    } else {
+      success = writer.Write(out, size);
+    }
+    start += size;
+  }
+  if (!destination) {
+    success = writer.Close() && success;
+    if (!success) {
+      fprintf(stderr, "%s: write error\n", (*sweep.file_names)[index].c_str());
+    }
+  }
+  return success;
+}
+
+void* Worker(void* arg) {
+#ifdef __SSE__
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+#endif  // __SSE__
+  Sweep* sweep = static_cast<Sweep*>(arg);
+  
+  // One processor per worker, initialized again for each point.
+  vector<uint8_t> large_buffer(kLargeBufferSize);
+  vector<uint8_t> small_buffer(kSmallBufferSize);
+  GranularProcessor* processor = new GranularProcessor;
+  while (true) {
+    size_t i = __atomic_fetch_add(&sweep->next_point, 1, __ATOMIC_RELAXED);
+    if (i >= sweep->points->size()) {
+      break;
+    }
+    if (!RenderPoint(
+        *sweep, i, processor, &large_buffer[0], &small_buffer[0])) {
+      __atomic_fetch_add(&sweep->num_failed, 1, __ATOMIC_RELAXED);
+    }
+  }
+  delete processor;
+  return NULL;
+}
+
+bool WriteMultichannelFile(const Sweep& sweep, const char* file_name) {
+  const vector<vector<ShortFrame> >& rendered = *sweep.rendered;
+  size_t num_channels = rendered.size() * 2;
+  WavWriter writer;
+  if (!writer.Open(file_name, sweep.sample_rate, num_channels)) {
+    fprintf(stderr, "%s: cannot create file\n", file_name);
+    return false;
+  }
+  vector<int16_t> samples(kRenderBlockSize * num_channels);
+  bool success = true;
+  for (size_t start = 0; start < sweep.num_frames && success; ) {
+    size_t size = min(sweep.num_frames - start, kRenderBlockSize);
+    for (size_t i = 0; i < rendered.size(); ++i) {
+      const ShortFrame* frame = &rendered[i][start];
+      int16_t* destination = &samples[i * 2];
+      for (size_t j = 0; j < size; ++j) {
+        destination[0] = frame->l;
+        destination[1] = frame->r;
+        destination += num_channels;
+        ++frame;
+      }
+    }
+    success = writer.WriteSamples(&samples[0], size);
+    start += size;
+  }
+  success = writer.Close() && success;
+  if (!success) {
+    fprintf(stderr, "%s: write error\n", file_name);
+  }
+  return success;
+}
+
+bool WriteIndex(
+    const char* file_name,
+    const ParameterSweep& parameter_sweep,
+    const vector<SweepPoint>& points,
+    const vector<string>& file_names) {
+  FILE* fp = fopen(file_name, "w");
+  if (!fp) {
+    fprintf(stderr, "%s: cannot create file\n", file_name);
+    return false;
+  }
+  fprintf(fp, "# point\tmode");
+  for (size_t i = 0; i < parameter_sweep.num_axes(); ++i) {
+    fprintf(fp, "\t%s", AutomationTargetName(parameter_sweep.axis(i).target));
+  }
+  fprintf(fp, file_names.empty() ? "\tchannels\n" : "\tfile\n");
+  for (size_t n = 0; n < points.size(); ++n) {
+    fprintf(fp, "%zu\t%s", n, PlaybackModeName(points[n].playback_mode));
+    for (size_t i = 0; i < points[n].values.size(); ++i) {
+      fprintf(fp, "\t%.4f", points[n].values[i]);
+    }
+    if (file_names.empty()) {
+      fprintf(fp, "\t%zu-%zu\n", 2 * n + 1, 2 * n + 2);
+    } else {
+      const char* name = strrchr(file_names[n].c_str(), '/');
+      fprintf(fp, "\t%s\n", name ? name + 1 : file_names[n].c_str());
+    }
+  }
+  bool success = !ferror(fp);
+  success = fclose(fp) == 0 && success;
+  if (!success) {
+    fprintf(stderr, "%s: write error\n", file_name);
+  }
+  return success;
+}
+
+string OutputPrefix(const char* directory, const char* input) {
+  const char* name = strrchr(input, '/');
+  name = name ? name + 1 : input;
+  const char* extension = strrchr(name, '.');
+  string prefix(directory);
+  prefix += '/';
+  prefix.append(name, extension ? extension - name : strlen(name));
+  return prefix;
+}
+
+void Usage() {
+  fprintf(stderr,
+      "usage: clouds_sweep [-j jobs] [-m modes] [-q quality] [-f taps] "
+      "[-r seed]\n"
+      "                    [-t tail] [-l points] [-c] [-o directory]\n"
+      "                    -p knob=values... input.wav\n");
+}
+
+int main(int argc, char** argv) {
+  long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  const char* output_directory = ".";
+  long num_random_points = 0;
+  bool multichannel = false;
+  
+  ParameterSweep parameter_sweep;
+  parameter_sweep.Init();
+  
+  Sweep sweep;
+  sweep.quality = 0;
+  sweep.src_filter = SRC_FILTER_1X_2_45;
+  sweep.seed = kDefaultRandomSeed;
+  float tail = 0.0f;
+  
+  int option;
+  while ((option = getopt(argc, argv, "j:m:q:f:r:t:l:co:p:h")) != -1) {
+    switch (option) {
+      case 'j':
+        num_threads = atol(optarg);
+        break;
+      case 'm':
+        if (!parameter_sweep.SetPlaybackModes(optarg)) {
+          return 1;
+        }
+        break;
+      case 'q':
+        sweep.quality = atoi(optarg) % kNumQualities;
+        break;
+      case 'f':
+        if (!ParseSrcFilter(atoi(optarg), &sweep.src_filter)) {
+          Usage();
+          return 1;
+        }
+        break;
+      case 'r':
+        sweep.seed = strtoul(optarg, NULL, 0);
+        break;
+      case 't':
+        tail = atof(optarg);
+        break;
+      case 'l':
+        num_random_points = atol(optarg);
+        break;
+      case 'c':
+        multichannel = true;
+        break;
+      case 'o':
+        output_directory = optarg;
+        break;
+      case 'p':
+        if (!parameter_sweep.AddAxis(optarg)) {
+          return 1;
+        }
+        break;
+      default:
+        Usage();
+        return 1;
+    }
+  }
+  if (optind != argc - 1 || num_random_points < 0 || tail < 0.0f) {
+    Usage();
+    return 1;
+  }
+  const char* input_file_name = argv[optind];
+  
+  vector<SweepPoint> points;
+  if (num_random_points) {
+    parameter_sweep.BuildLatinHypercube(
+        num_random_points, sweep.seed, &points);
+  } else if (!parameter_sweep.BuildGrid(&points)) {
+    return 1;
+  }
+  
+  WavReader reader;
+  if (!reader.Open(input_file_name)) {
+    fprintf(stderr, "%s: %s\n", input_file_name, reader.error());
+    return 1;
+  }
+  vector<ShortFrame> input(reader.num_frames());
+  if (!input.empty()) {
+    input.resize(reader.Read(&input[0], input.size()));
+  }
+  reader.Close();
+  
+  sweep.parameter_sweep = &parameter_sweep;
+  sweep.points = &points;
+  sweep.input = &input;
+  sweep.sample_rate = reader.sample_rate();
+  sweep.num_frames = input.size() + static_cast<size_t>(
+      tail * sweep.sample_rate);
+  // The tail is rounded up to whole engine blocks, which the engine processes
+  // without latency.
+  sweep.num_frames = (sweep.num_frames + kMaxBlockSize - 1) &
+      ~(kMaxBlockSize - 1);
+  sweep.next_point = 0;
+  sweep.num_failed = 0;
+  if (!sweep.num_frames) {
+    fprintf(stderr, "%s: nothing to render\n", input_file_name);
+    return 1;
+  }
+  
+  string prefix = OutputPrefix(output_directory, input_file_name);
+  vector<string> file_names;
+  vector<vector<ShortFrame> > rendered;
+  if (multichannel) {
+    // A WAV file holds at most 65535 channels and 4GB of samples.
+    uint64_t size = static_cast<uint64_t>(sweep.num_frames) * points.size() *
+        sizeof(ShortFrame);
+    if (points.size() * 2 > 65535 || size >= 0xffffffc0) {
+      fprintf(stderr, "too many points for a single file\n");
+      return 1;
+    }
+    rendered.resize(points.size());
+    sweep.rendered = &rendered;
+    sweep.file_names = NULL;
+  } else {
+    // Numbers are padded to the same width, so that files sort in order.
+    size_t num_digits = 4;
+    for (size_t n = points.size() - 1; n >= 10000; n /= 10) {
+      ++num_digits;
+    }
+    char number[24];
+    for (size_t n = 0; n < points.size(); ++n) {
+      size_t length = snprintf(number, sizeof(number), "%zu", n);
+      string padding(length < num_digits ? num_digits - length : 0, '0');
+      file_names.push_back(prefix + "." + padding + number + ".wav");
+    }
+    sweep.rendered = NULL;
+    sweep.file_names = &file_names;
+  }
+  if (!WriteIndex(
+      (prefix + ".sweep.txt").c_str(), parameter_sweep, points, file_names)) {
+    return 1;
+  }
+  
+  if (num_threads < 1) {
+    num_threads = 1;
+  } else if (static_cast<size_t>(num_threads) > points.size()) {
+    num_threads = points.size();
+  }
+  vector<pthread_t> threads(num_threads);
+  long num_started = 0;
+  for (; num_started < num_threads; ++num_started) {
+    if (pthread_create(&threads[num_started], NULL, &Worker, &sweep)) {
+      break;
+    }
+  }
+  if (!num_started) {
+    Worker(&sweep);
+  }
+  for (long i = 0; i < num_started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  
+  if (sweep.num_failed) {
+    return 1;
+  }
+  if (multichannel &&
+      !WriteMultichannelFile(sweep, (prefix + ".sweep.wav").c_str())) {
+    return 1;
+  }
+  fprintf(stderr, "%zu points rendered\n", points.size());
+  return 0;
+}
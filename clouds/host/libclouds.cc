@@ -0,0 +1,414 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// C interface of the engine.
+
+#include "clouds/host/libclouds.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/dsp/sample_conversion.h"
+#include "clouds/host/pipelined_processor.h"
+#include "clouds/host/resampling_processor.h"
+
+using namespace clouds;
+using namespace std;
+
+// Same sample memory as the firmware.
+const size_t kLargeBufferSize = 118784;
+const size_t kSmallBufferSize = 65536 - 128;
+
+const size_t kAlignment = 16;
+
+// Number of frames converted and processed at once. Prepare() runs after
+// each chunk.
+const size_t kChunkSize = 256;
+
+struct clouds_processor {
+  GranularProcessor engine;
+  void* memory;
+  bool owns_memory;
+  float sample_rate;
+  
+  // When the engine runs at its own rate.
+  ResamplingProcessor* resampler;
+  
+  // When the post-processing runs on a thread of its own.
+  PipelinedProcessor* pipeline;
+  
+  // Changes waiting for the next call to one of the process functions.
+  float value[CLOUDS_PARAMETER_LAST];
+  bool changed[CLOUDS_PARAMETER_LAST];
+  
+  ShortFrame in[kChunkSize];
+  ShortFrame out[kChunkSize];
+};
+
+static inline size_t Align(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+static clouds_processor* Create(
+    void* memory,
+    bool owns_memory,
+    float sample_rate) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(memory);
+  uint8_t* p = static_cast<uint8_t*>(memory) + (Align(address) - address);
+  clouds_processor* processor = new(p) clouds_processor;
+  p += Align(sizeof(clouds_processor));
+  
+  processor->memory = memory;
+  processor->owns_memory = owns_memory;
+  processor->sample_rate = sample_rate;
+  processor->resampler = NULL;
+  processor->pipeline = NULL;
+  fill(&processor->changed[0], &processor->changed[CLOUDS_PARAMETER_LAST],
+      false);
+  
+  GranularProcessor* engine = &processor->engine;
+  engine->Init(p, kLargeBufferSize, p + kLargeBufferSize, kSmallBufferSize);
+  engine->set_sample_rate(sample_rate);
+  Parameters* parameters = engine->mutable_parameters();
+  parameters->position = 0.0f;
+  parameters->size = 0.5f;
+  parameters->pitch = 0.0f;
+  parameters->density = 0.5f;
+  parameters->texture = 0.5f;
+  parameters->dry_wet = 0.5f;
+  parameters->stereo_spread = 0.0f;
+  parameters->feedback = 0.0f;
+  parameters->reverb = 0.0f;
+  do {
+    engine->Prepare();
+  } while (!engine->ready());
+  return processor;
+}
+
+static size_t CollectEvents(
+    clouds_processor* processor,
+    AutomationEvent* events) {
+  size_t num_events = 0;
+  for (int32_t i = 0; i < CLOUDS_PARAMETER_LAST; ++i) {
+    if (processor->changed[i]) {
+      AutomationEvent e = {
+        0, static_cast<AutomationTarget>(i), processor->value[i]
+      };
+      events[num_events++] = e;
+      processor->changed[i] = false;
+    }
+  }
+  return num_events;
+}
+
+static void Process(clouds_processor* processor, size_t size) {
+  AutomationEvent events[CLOUDS_PARAMETER_LAST];
+  size_t num_events = CollectEvents(processor, events);
+  if (processor->resampler) {
+    processor->resampler->Process(
+        processor->in, processor->out, size,
+        num_events ? events : NULL, num_events);
+  } else if (processor->pipeline) {
+    processor->pipeline->Process(
+        processor->in, processor->out, size,
+        num_events ? events : NULL, num_events);
+    processor->pipeline->Prepare();
+  } else {
+    processor->engine.Process(
+        processor->in, processor->out, size,
+        num_events ? events : NULL, num_events);
+    processor->engine.Prepare();
+  }
+}
+
+// The settings of the engine must not change while the worker of the
+// pipeline processes a block.
+static void Sync(clouds_processor* processor) {
+  if (processor->pipeline) {
+    processor->pipeline->Drain();
+  }
+}
+
+static void StopPipeline(clouds_processor* processor) {
+  if (processor->pipeline) {
+    processor->pipeline->Stop();
+    delete processor->pipeline;
+    processor->pipeline = NULL;
+  }
+}
+
+extern "C" {
+
+int clouds_api_version(void) {
+  return CLOUDS_API_VERSION;
+}
+
+size_t clouds_footprint(void) {
+  return kAlignment - 1 + Align(sizeof(clouds_processor)) +
+      kLargeBufferSize + kSmallBufferSize;
+}
+
+clouds_processor* clouds_create(float sample_rate) {
+  if (!(sample_rate > 0.0f)) {
+    return NULL;
+  }
+  void* memory = malloc(clouds_footprint());
+  return memory ? Create(memory, true, sample_rate) : NULL;
+}
+
+clouds_processor* clouds_create_with_memory(
+    void* memory,
+    size_t size,
+    float sample_rate) {
+  if (!memory || size < clouds_footprint() || !(sample_rate > 0.0f)) {
+    return NULL;
+  }
+  return Create(memory, false, sample_rate);
+}
+
+void clouds_destroy(clouds_processor* processor) {
+  if (!processor) {
+    return;
+  }
+  void* memory = processor->owns_memory ? processor->memory : NULL;
+  StopPipeline(processor);
+  delete processor->resampler;
+  processor->~clouds_processor();
+  free(memory);
+}
+
+void clouds_process_interleaved_float(
+    clouds_processor* processor,
+    const float* in,
+    float* out,
+    size_t num_frames) {
+  while (num_frames) {
+    size_t size = min(num_frames, kChunkSize);
+    FloatToShort(in, 1, &processor->in[0].l, size * 2, 32768.0f);
+    Process(processor, size);
+    ShortToFloat(&processor->out[0].l, out, 1, size * 2, 1.0f / 32768.0f);
+    in += size * 2;
+    out += size * 2;
+    num_frames -= size;
+  }
+}
+
+void clouds_process_interleaved_int16(
+    clouds_processor* processor,
+    const int16_t* in,
+    int16_t* out,
+    size_t num_frames) {
+  while (num_frames) {
+    size_t size = min(num_frames, kChunkSize);
+    memcpy(processor->in, in, size * sizeof(ShortFrame));
+    Process(processor, size);
+    memcpy(out, processor->out, size * sizeof(ShortFrame));
+    in += size * 2;
+    out += size * 2;
+    num_frames -= size;
+  }
+}
+
+void clouds_process_planar_float(
+    clouds_processor* processor,
+    const float* const* in,
+    float* const* out,
+    size_t num_frames) {
+  const float* in_l = in[0];
+  const float* in_r = in[1];
+  float* out_l = out[0];
+  float* out_r = out[1];
+  while (num_frames) {
+    size_t size = min(num_frames, kChunkSize);
+    for (size_t i = 0; i < size; ++i) {
+      processor->in[i].l = stmlib::Clip16(
+          static_cast<int32_t>(*in_l++ * 32768.0f));
+      processor->in[i].r = stmlib::Clip16(
+          static_cast<int32_t>(*in_r++ * 32768.0f));
+    }
+    Process(processor, size);
+    for (size_t i = 0; i < size; ++i) {
+      *out_l++ = static_cast<float>(processor->out[i].l) / 32768.0f;
+      *out_r++ = static_cast<float>(processor->out[i].r) / 32768.0f;
+    }
+    num_frames -= size;
+  }
+}
+
+void clouds_process_planar_int16(
+    clouds_processor* processor,
+    const int16_t* const* in,
+    int16_t* const* out,
+    size_t num_frames) {
+  const int16_t* in_l = in[0];
+  const int16_t* in_r = in[1];
+  int16_t* out_l = out[0];
+  int16_t* out_r = out[1];
+  while (num_frames) {
+    size_t size = min(num_frames, kChunkSize);
+    for (size_t i = 0; i < size; ++i) {
+      processor->in[i].l = *in_l++;
+      processor->in[i].r = *in_r++;
+    }
+    Process(processor, size);
+    for (size_t i = 0; i < size; ++i) {
+      *out_l++ = processor->out[i].l;
+      *out_r++ = processor->out[i].r;
+    }
+    num_frames -= size;
+  }
+}
+
+int clouds_set_parameter(
+    clouds_processor* processor,
+    clouds_parameter parameter,
+    float value) {
+  if (parameter < 0 || parameter >= CLOUDS_PARAMETER_LAST || value != value) {
+    return -1;
+  }
+  processor->value[parameter] = value;
+  processor->changed[parameter] = true;
+  return 0;
+}
+
+int clouds_set_mode(clouds_processor* processor, clouds_mode mode) {
+  if (mode < 0 || mode >= CLOUDS_MODE_LAST) {
+    return -1;
+  }
+  Sync(processor);
+  processor->engine.set_playback_mode(static_cast<PlaybackMode>(mode));
+  return 0;
+}
+
+int clouds_set_quality(clouds_processor* processor, int quality) {
+  if (quality < 0 || quality >= kNumQualities) {
+    return -1;
+  }
+  Sync(processor);
+  processor->engine.set_quality(quality);
+  return 0;
+}
+
+int clouds_set_src_filter(clouds_processor* processor, int num_taps) {
+  Sync(processor);
+  switch (num_taps) {
+    case SRC_FILTER_1X_2_31_SIZE:
+      processor->engine.set_src_filter(SRC_FILTER_1X_2_31);
+      return 0;
+    case SRC_FILTER_1X_2_45_SIZE:
+      processor->engine.set_src_filter(SRC_FILTER_1X_2_45);
+      return 0;
+    case SRC_FILTER_1X_2_63_SIZE:
+      processor->engine.set_src_filter(SRC_FILTER_1X_2_63);
+      return 0;
+    case SRC_FILTER_1X_2_91_SIZE:
+      processor->engine.set_src_filter(SRC_FILTER_1X_2_91);
+      return 0;
+  }
+  return -1;
+}
+
+int clouds_set_engine_sample_rate(
+    clouds_processor* processor,
+    float engine_rate) {
+  if (!(engine_rate >= 0.0f)) {
+    return -1;
+  }
+  int32_t host_rate = static_cast<int32_t>(processor->sample_rate + 0.5f);
+  int32_t rate = static_cast<int32_t>(engine_rate + 0.5f);
+  ResamplingProcessor* resampler = NULL;
+  if (rate && rate != host_rate) {
+    if (processor->pipeline) {
+      return -1;
+    }
+    resampler = new(nothrow) ResamplingProcessor;
+    if (!resampler || !resampler->Init(&processor->engine, host_rate, rate)) {
+      delete resampler;
+      return -1;
+    }
+  } else {
+    Sync(processor);
+    processor->engine.set_sample_rate(processor->sample_rate);
+  }
+  delete processor->resampler;
+  processor->resampler = resampler;
+  do {
+    processor->engine.Prepare();
+  } while (!processor->engine.ready());
+  return 0;
+}
+
+int clouds_set_pipelined(clouds_processor* processor, int enabled) {
+  if (!enabled) {
+    StopPipeline(processor);
+    return 0;
+  }
+  if (processor->resampler) {
+    return -1;
+  }
+  if (!processor->pipeline) {
+    PipelinedProcessor* pipeline = new(nothrow) PipelinedProcessor;
+    if (!pipeline || !pipeline->Init(&processor->engine)) {
+      delete pipeline;
+      return -1;
+    }
+    processor->pipeline = pipeline;
+  }
+  return 0;
+}
+
+size_t clouds_latency(const clouds_processor* processor) {
+  if (processor->resampler) {
+    return static_cast<size_t>(processor->resampler->latency() + 0.5f);
+  } else if (processor->pipeline) {
+    return processor->pipeline->latency();
+  }
+  return processor->engine.latency();
+}
+
+size_t clouds_tail(const clouds_processor* processor) {
+  const Parameters& parameters = processor->engine.parameters();
+  bool freeze = processor->changed[CLOUDS_PARAMETER_FREEZE]
+      ? processor->value[CLOUDS_PARAMETER_FREEZE] != 0.0f
+      : parameters.freeze;
+  float feedback = processor->changed[CLOUDS_PARAMETER_FEEDBACK]
+      ? processor->value[CLOUDS_PARAMETER_FEEDBACK]
+      : parameters.feedback;
+  if (freeze || feedback > 0.0f ||
+      processor->engine.inf_reverb()) {
+    return CLOUDS_INFINITE_TAIL;
+  }
+  if (processor->resampler) {
+    return static_cast<size_t>(processor->resampler->host_frames(
+        processor->engine.tail_length()) + 0.5f) + clouds_latency(processor);
+  }
+  return processor->engine.tail_length() + clouds_latency(processor);
+}
+
+}  // extern "C"
@@ -0,0 +1,180 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// C interface of the engine, for hosts embedding it.
+//
+// All functions of an instance must be called from the same thread, or be
+// serialized by the host. Audio is stereo, at any number of frames per call.
+// Float samples are full scale at +/-1.0.
+
+#ifndef CLOUDS_HOST_LIBCLOUDS_H_
+#define CLOUDS_HOST_LIBCLOUDS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+  #define CLOUDS_API __attribute__((visibility("default")))
+#else
+  #define CLOUDS_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Incremented when the interface changes in an incompatible way. */
+#define CLOUDS_API_VERSION 1
+
+/* Returned by clouds_tail() when the output can last forever. */
+#define CLOUDS_INFINITE_TAIL ((size_t) -1)
+
+typedef struct clouds_processor clouds_processor;
+
+typedef enum {
+  CLOUDS_PARAMETER_POSITION,
+  CLOUDS_PARAMETER_SIZE,
+  CLOUDS_PARAMETER_PITCH,  /* In semitones, -48 to +48. */
+  CLOUDS_PARAMETER_DENSITY,
+  CLOUDS_PARAMETER_TEXTURE,
+  CLOUDS_PARAMETER_DRY_WET,
+  CLOUDS_PARAMETER_STEREO_SPREAD,
+  CLOUDS_PARAMETER_FEEDBACK,
+  CLOUDS_PARAMETER_REVERB,
+  CLOUDS_PARAMETER_FREEZE,  /* Off at 0, on otherwise. */
+  CLOUDS_PARAMETER_GATE,  /* Off at 0, on otherwise. */
+  CLOUDS_PARAMETER_TRIGGER,  /* Fires at the start of the next call. */
+  CLOUDS_PARAMETER_LAST
+} clouds_parameter;
+
+typedef enum {
+  CLOUDS_MODE_GRANULAR,
+  CLOUDS_MODE_STRETCH,
+  CLOUDS_MODE_LOOPING_DELAY,
+  CLOUDS_MODE_SPECTRAL,
+  CLOUDS_MODE_OLIVERB,
+  CLOUDS_MODE_RESONESTOR,
+  CLOUDS_MODE_LAST
+} clouds_mode;
+
+CLOUDS_API int clouds_api_version(void);
+
+/* Number of bytes of memory used by an instance, sample memory included. */
+CLOUDS_API size_t clouds_footprint(void);
+
+/* Allocates the memory of the instance. Returns NULL on failure. */
+CLOUDS_API clouds_processor* clouds_create(float sample_rate);
+
+/* Uses size bytes at memory, which must be at least clouds_footprint().
+   Returns NULL if it is too small. The memory is not freed by
+   clouds_destroy(). */
+CLOUDS_API clouds_processor* clouds_create_with_memory(
+    void* memory,
+    size_t size,
+    float sample_rate);
+
+CLOUDS_API void clouds_destroy(clouds_processor* processor);
+
+/* in and out can be the same buffer. */
+CLOUDS_API void clouds_process_interleaved_float(
+    clouds_processor* processor,
+    const float* in,
+    float* out,
+    size_t num_frames);
+
+CLOUDS_API void clouds_process_interleaved_int16(
+    clouds_processor* processor,
+    const int16_t* in,
+    int16_t* out,
+    size_t num_frames);
+
+/* in[0] and out[0] are the left channel, in[1] and out[1] the right one. */
+CLOUDS_API void clouds_process_planar_float(
+    clouds_processor* processor,
+    const float* const* in,
+    float* const* out,
+    size_t num_frames);
+
+CLOUDS_API void clouds_process_planar_int16(
+    clouds_processor* processor,
+    const int16_t* const* in,
+    int16_t* const* out,
+    size_t num_frames);
+
+/* Knobs range from 0 to 1, unless noted otherwise. Changes take effect at
+   the start of the next call to one of the process functions. Return 0, or
+   -1 on an invalid argument. */
+CLOUDS_API int clouds_set_parameter(
+    clouds_processor* processor,
+    clouds_parameter parameter,
+    float value);
+
+/* Switching mode or quality reinitializes the sample memory. Quality is 0 to
+   5: bit 0 selects mono, bits 1-2 the decimation of the recording - none,
+   by 2 or by 4 - as on the module. */
+CLOUDS_API int clouds_set_mode(clouds_processor* processor, clouds_mode mode);
+CLOUDS_API int clouds_set_quality(clouds_processor* processor, int quality);
+
+/* Length of the resampling filter used in low fidelity, 31, 45 (default),
+   63 or 91 taps: the shorter filters use less CPU, the longer ones alias
+   less. */
+CLOUDS_API int clouds_set_src_filter(clouds_processor* processor, int num_taps);
+
+/* Runs the engine at engine_rate - 32000 Hz for the sound of the module,
+   whose buffers last as long at this rate - and converts the audio from and
+   to the rate of the instance with a high quality resampler, which adds to
+   the latency. 0, or the rate of the instance, runs the engine at the rate
+   of the instance. Reinitializes the sample memory, and allocates memory,
+   even for instances created with clouds_create_with_memory(). Returns -1 if
+   the ratio of the rates is not supported, or if the instance is
+   pipelined. */
+CLOUDS_API int clouds_set_engine_sample_rate(
+    clouds_processor* processor,
+    float engine_rate);
+
+/* When enabled, the effects and the mixing of each block of 32 frames run on
+   a thread of their own, while the process functions run the engine on the
+   next block. This adds 32 frames of latency, and as many to the feedback
+   path: the output differs from the one of a serial instance when the
+   feedback is above 0. Switching it on or off changes the latency, and drops
+   the frames in flight. Allocates memory. Returns -1 if the thread cannot be
+   started, or if the engine runs at its own rate. */
+CLOUDS_API int clouds_set_pipelined(clouds_processor* processor, int enabled);
+
+/* Delay, in frames, of the dry signal from input to output. Without
+   resampling or pipelining, it is 0 as long as the process functions are
+   given multiples of 32 frames, and 32 from the first call with any other
+   size on. Pipelining adds 32 frames. */
+CLOUDS_API size_t clouds_latency(const clouds_processor* processor);
+
+/* Number of frames the output can last once the input has become silent. */
+CLOUDS_API size_t clouds_tail(const clouds_processor* processor);
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* CLOUDS_HOST_LIBCLOUDS_H_ */
@@ -0,0 +1,188 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Clocked loopback device.
+
+#include "clouds/host/loopback_codec.h"
+
+#include <sched.h>
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif  // __SSE__
+
+namespace clouds {
+
+using namespace std;
+
+size_t FrameRing::Write(const ShortFrame* frames, size_t size) {
+  size = min(size, writable());
+  size_t w = __atomic_load_n(&write_ptr_, __ATOMIC_RELAXED);
+  for (size_t i = 0; i < size; ++i) {
+    frames_[(w + i) & mask_] = frames[i];
+  }
+  __atomic_store_n(&write_ptr_, (w + size) & mask_, __ATOMIC_RELEASE);
+  return size;
+}
+
+size_t FrameRing::Read(ShortFrame* frames, size_t size) {
+  size = min(size, readable());
+  size_t r = __atomic_load_n(&read_ptr_, __ATOMIC_RELAXED);
+  for (size_t i = 0; i < size; ++i) {
+    frames[i] = frames_[(r + i) & mask_];
+  }
+  __atomic_store_n(&read_ptr_, (r + size) & mask_, __ATOMIC_RELEASE);
+  return size;
+}
+
+static inline int64_t Now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<int64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+static inline void SleepUntil(int64_t time) {
+  struct timespec t;
+  t.tv_sec = time / 1000000000;
+  t.tv_nsec = time % 1000000000;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR) { }
+}
+
+void LoopbackCodec::Init(int32_t sample_rate, FrameRing* rx, FrameRing* tx) {
+  sample_rate_ = sample_rate;
+  rx_ = rx;
+  tx_ = tx;
+  running_ = false;
+  real_time_ = false;
+  
+  LoopbackStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats_.Init(stats);
+}
+
+bool LoopbackCodec::Start(
+    size_t block_size,
+    FillBufferCallback callback,
+    int32_t priority) {
+  if (block_size < 1 || block_size > kMaxCodecBlockSize) {
+    return false;
+  }
+  block_size_ = block_size;
+  period_ = static_cast<int64_t>(block_size) * 1000000000 / sample_rate_;
+  callback_ = callback;
+  running_ = true;
+  
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+  struct sched_param parameters;
+  parameters.sched_priority = priority;
+  pthread_attr_setschedparam(&attributes, &parameters);
+  real_time_ = !pthread_create(&thread_, &attributes, &CodecThread, this);
+  pthread_attr_destroy(&attributes);
+  
+  // Not allowed to (RLIMIT_RTPRIO, container...): run anyway.
+  if (!real_time_ && pthread_create(&thread_, NULL, &CodecThread, this)) {
+    running_ = false;
+    return false;
+  }
+  return true;
+}
+
+void LoopbackCodec::Stop() {
+  if (!__atomic_load_n(&running_, __ATOMIC_RELAXED)) {
+    return;
+  }
+  __atomic_store_n(&running_, false, __ATOMIC_RELAXED);
+  pthread_join(thread_, NULL);
+}
+
+/* static */
+void* LoopbackCodec::CodecThread(void* self) {
+  // Denormals are flushed to zero on the module too.
+#ifdef __SSE__
+  _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+#endif  // __SSE__
+  static_cast<LoopbackCodec*>(self)->Run();
+  return NULL;
+}
+
+void LoopbackCodec::Run() {
+  // Wake-up times are derived from the number of frames elapsed, so that
+  // rounding errors on the period do not accumulate.
+  int64_t start = Now();
+  int64_t frame = 0;
+  int64_t block_size = block_size_;
+  LoopbackStats* s = stats_.mutable_back();
+  
+  while (__atomic_load_n(&running_, __ATOMIC_RELAXED)) {
+    frame += block_size;
+    int64_t wake_up = start + frame * 1000000000 / sample_rate_;
+    SleepUntil(wake_up);
+    int64_t begin = Now();
+    
+    size_t size = rx_ ? rx_->Read(rx_buffer_, block_size_) : 0;
+    if (rx_ && size < block_size_) {
+      ++s->num_underruns;
+    }
+    fill(&rx_buffer_[size], &rx_buffer_[block_size_], ShortFrame());
+    
+    callback_(rx_buffer_, tx_buffer_, block_size_);
+    
+    if (tx_ && tx_->Write(tx_buffer_, block_size_) < block_size_) {
+      ++s->num_overruns;
+    }
+    int64_t end = Now();
+    
+    int64_t duration = end - begin;
+    ++s->num_periods;
+    s->callback_time += duration;
+    s->max_callback_time = max(s->max_callback_time, duration);
+    s->max_wake_up_delay = max(s->max_wake_up_delay, begin - wake_up);
+    int64_t bin = duration * kLoadHistogramResolution / period_;
+    ++s->load_histogram[min(bin, int64_t(kLoadHistogramSize - 1))];
+    
+    int64_t deadline = wake_up + period_;
+    if (end > deadline) {
+      // The periods which have started in the meantime are skipped.
+      ++s->num_missed_deadlines;
+      while (start + (frame + block_size) * 1000000000 / sample_rate_ < end) {
+        frame += block_size;
+        ++s->num_lost_periods;
+      }
+    }
+    stats_.Publish();
+    s = stats_.mutable_back();
+  }
+}
+
+}  // namespace clouds
@@ -0,0 +1,162 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Stand-in for the codec on Linux hosts without an audio interface. A thread -
+// real-time when the system allows it - wakes up every period, at wall-clock
+// rate, and calls the FillBuffer callback, the way the DMA interrupt does on
+// the module. The input frames are taken from a ring buffer and the output
+// frames pushed to another one; without rings, the input is silent and the
+// output is dropped.
+//
+// The thread keeps track of xruns and of the time spent in the callback.
+
+#ifndef CLOUDS_HOST_LOOPBACK_CODEC_H_
+#define CLOUDS_HOST_LOOPBACK_CODEC_H_
+
+#include "stmlib/stmlib.h"
+
+#include <pthread.h>
+
+#include <vector>
+
+#include "clouds/dsp/control_channel.h"
+#include "clouds/dsp/frame.h"
+
+namespace clouds {
+
+const size_t kMaxCodecBlockSize = 1024;
+
+// The callback duration histogram has bins of 1/kLoadHistogramResolution of
+// the period. The last bin holds all the callbacks longer than that.
+const int32_t kLoadHistogramResolution = 20;
+const int32_t kLoadHistogramSize = 2 * kLoadHistogramResolution + 1;
+
+// Single-producer/single-consumer ring of frames. The capacity is a power of
+// 2; one slot is kept empty.
+class FrameRing {
+ public:
+  FrameRing() { }
+  ~FrameRing() { }
+  
+  void Init(size_t capacity) {
+    frames_.resize(capacity);
+    mask_ = capacity - 1;
+    read_ptr_ = 0;
+    write_ptr_ = 0;
+  }
+  
+  // Both return the number of frames actually transferred.
+  size_t Write(const ShortFrame* frames, size_t size);
+  size_t Read(ShortFrame* frames, size_t size);
+  
+  inline size_t readable() const {
+    return (__atomic_load_n(&write_ptr_, __ATOMIC_ACQUIRE) -
+        __atomic_load_n(&read_ptr_, __ATOMIC_ACQUIRE)) & mask_;
+  }
+  
+  inline size_t writable() const {
+    return mask_ - readable();
+  }
+  
+ private:
+  std::vector<ShortFrame> frames_;
+  size_t mask_;
+  size_t read_ptr_;
+  size_t write_ptr_;
+  
+  DISALLOW_COPY_AND_ASSIGN(FrameRing);
+};
+
+struct LoopbackStats {
+  uint32_t num_periods;
+  // Callbacks which were not done by the end of their period. The periods
+  // that went by in the meantime are lost, as with a real codec.
+  uint32_t num_missed_deadlines;
+  uint32_t num_lost_periods;
+  // Input ring empty, output ring full.
+  uint32_t num_underruns;
+  uint32_t num_overruns;
+  
+  int64_t callback_time;  // ns, total
+  int64_t max_callback_time;
+  int64_t max_wake_up_delay;
+  uint32_t load_histogram[kLoadHistogramSize];
+};
+
+class LoopbackCodec {
+ public:
+  LoopbackCodec() { }
+  ~LoopbackCodec() { }
+  
+  typedef void (*FillBufferCallback)(
+      ShortFrame* rx,
+      ShortFrame* tx,
+      size_t size);
+  
+  // rx and tx can be NULL.
+  void Init(int32_t sample_rate, FrameRing* rx, FrameRing* tx);
+  
+  // Returns false if the thread cannot be started. When SCHED_FIFO is
+  // refused, falls back to a normal thread - see real_time().
+  bool Start(size_t block_size, FillBufferCallback callback, int32_t priority);
+  void Stop();
+  
+  // Statistics as of the last period. To be called from a single thread
+  // other than the codec one.
+  const LoopbackStats& stats() {
+    stats_.Fetch();
+    return stats_.front();
+  }
+  
+  inline bool real_time() const { return real_time_; }
+  inline int64_t period() const { return period_; }
+  
+ private:
+  static void* CodecThread(void* self);
+  void Run();
+  
+  int32_t sample_rate_;
+  size_t block_size_;
+  int64_t period_;  // ns
+  FillBufferCallback callback_;
+  
+  FrameRing* rx_;
+  FrameRing* tx_;
+  ShortFrame rx_buffer_[kMaxCodecBlockSize];
+  ShortFrame tx_buffer_[kMaxCodecBlockSize];
+  
+  SnapshotBuffer<LoopbackStats> stats_;
+  
+  bool running_;
+  bool real_time_;
+  pthread_t thread_;
+  
+  DISALLOW_COPY_AND_ASSIGN(LoopbackCodec);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_LOOPBACK_CODEC_H_
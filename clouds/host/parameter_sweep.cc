@@ -0,0 +1,221 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Points of a parameter sweep.
+
+#include "clouds/host/parameter_sweep.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "clouds/dsp/random.h"
+#include "clouds/host/render_script.h"
+
+namespace clouds {
+
+using namespace std;
+
+void ParameterSweep::Init() {
+  axes_.clear();
+  playback_modes_.clear();
+  playback_modes_.push_back(PLAYBACK_MODE_GRANULAR);
+}
+
+static bool ParseFloat(const char* s, char** end, float* value) {
+  *value = strtof(s, end);
+  return *end != s;
+}
+
+bool ParameterSweep::AddAxis(const char* specification) {
+  SweepAxis axis;
+  
+  char name[32];
+  const char* equal = strchr(specification, '=');
+  size_t length = equal ? equal - specification : 0;
+  if (!length || length >= sizeof(name)) {
+    fprintf(stderr, "%s: expected knob=values\n", specification);
+    return false;
+  }
+  memcpy(name, specification, length);
+  name[length] = '\0';
+  if (!ParseAutomationTarget(name, &axis.target) ||
+      axis.target >= AUTOMATION_GATE) {
+    fprintf(stderr, "%s: unknown knob\n", name);
+    return false;
+  }
+  for (size_t i = 0; i < axes_.size(); ++i) {
+    if (axes_[i].target == axis.target) {
+      fprintf(stderr, "%s: knob swept twice\n", name);
+      return false;
+    }
+  }
+  
+  const char* s = equal + 1;
+  char* end;
+  float value;
+  bool ok = ParseFloat(s, &end, &value);
+  if (ok && *end == ':') {
+    axis.range = true;
+    axis.minimum = value;
+    ok = ParseFloat(end + 1, &end, &axis.maximum);
+    if (ok && *end == ':') {
+      long num_steps = strtol(end + 1, &end, 10);
+      ok = num_steps >= 1 && num_steps <= static_cast<long>(kMaxSweepPoints);
+      for (long i = 0; ok && i < num_steps; ++i) {
+        float x = num_steps == 1
+            ? 0.0f
+            : static_cast<float>(i) / static_cast<float>(num_steps - 1);
+        axis.values.push_back(axis.minimum + (axis.maximum - axis.minimum) * x);
+      }
+    }
+  } else {
+    axis.range = false;
+    axis.values.push_back(value);
+    while (ok && *end == ',') {
+      ok = ParseFloat(end + 1, &end, &value);
+      axis.values.push_back(value);
+    }
+  }
+  if (!ok || *end) {
+    fprintf(stderr, "%s: invalid values\n", specification);
+    return false;
+  }
+  axes_.push_back(axis);
+  return true;
+}
+
+bool ParameterSweep::SetPlaybackModes(const char* list) {
+  playback_modes_.clear();
+  char name[32];
+  while (*list) {
+    size_t length = strcspn(list, ",");
+    if (length >= sizeof(name)) {
+      length = sizeof(name) - 1;
+    }
+    memcpy(name, list, length);
+    name[length] = '\0';
+    PlaybackMode playback_mode;
+    if (!ParsePlaybackMode(name, &playback_mode)) {
+      fprintf(stderr, "%s: unknown mode\n", name);
+      return false;
+    }
+    playback_modes_.push_back(playback_mode);
+    list += strcspn(list, ",");
+    if (*list) {
+      ++list;
+    }
+  }
+  if (playback_modes_.empty()) {
+    fprintf(stderr, "no mode given\n");
+    return false;
+  }
+  return true;
+}
+
+bool ParameterSweep::BuildGrid(vector<SweepPoint>* points) const {
+  size_t num_points = playback_modes_.size();
+  for (size_t i = 0; i < axes_.size(); ++i) {
+    if (axes_[i].values.empty()) {
+      fprintf(stderr, "%s: a grid needs a number of steps\n",
+          AutomationTargetName(axes_[i].target));
+      return false;
+    }
+    num_points *= axes_[i].values.size();
+    if (num_points > kMaxSweepPoints) {
+      fprintf(stderr, "too many points\n");
+      return false;
+    }
+  }
+  
+  // The last axis varies the fastest, the modes the slowest.
+  points->resize(num_points);
+  for (size_t n = 0; n < num_points; ++n) {
+    SweepPoint* point = &(*points)[n];
+    point->values.resize(axes_.size());
+    size_t index = n;
+    for (size_t i = axes_.size(); i--; ) {
+      const vector<float>& values = axes_[i].values;
+      point->values[i] = values[index % values.size()];
+      index /= values.size();
+    }
+    point->playback_mode = playback_modes_[index];
+  }
+  return true;
+}
+
+static void Shuffle(RandomGenerator* random, vector<size_t>* strata) {
+  for (size_t i = 0; i < strata->size(); ++i) {
+    (*strata)[i] = i;
+  }
+  for (size_t i = strata->size(); i > 1; --i) {
+    swap((*strata)[i - 1], (*strata)[random->GetWord() % i]);
+  }
+}
+
+void ParameterSweep::BuildLatinHypercube(
+    size_t num_points,
+    uint32_t seed,
+    vector<SweepPoint>* points) const {
+  RandomGenerator random;
+  random.Seed(seed);
+  
+  points->resize(num_points);
+  vector<size_t> strata(num_points);
+  
+  // Each axis, and the modes, get their own permutation of the strata.
+  Shuffle(&random, &strata);
+  for (size_t n = 0; n < num_points; ++n) {
+    SweepPoint* point = &(*points)[n];
+    point->playback_mode = playback_modes_[
+        strata[n] * playback_modes_.size() / num_points];
+    point->values.resize(axes_.size());
+  }
+  for (size_t i = 0; i < axes_.size(); ++i) {
+    const SweepAxis& axis = axes_[i];
+    Shuffle(&random, &strata);
+    for (size_t n = 0; n < num_points; ++n) {
+      float* value = &(*points)[n].values[i];
+      if (axis.range) {
+        float x = (strata[n] + random.GetFloat()) / num_points;
+        *value = axis.minimum + (axis.maximum - axis.minimum) * x;
+      } else {
+        *value = axis.values[strata[n] * axis.values.size() / num_points];
+      }
+    }
+  }
+}
+
+void ParameterSweep::GetEvents(
+    const SweepPoint& point,
+    vector<AutomationEvent>* events) const {
+  for (size_t i = 0; i < axes_.size(); ++i) {
+    AutomationEvent e = { 0, axes_[i].target, point.values[i] };
+    events->push_back(e);
+  }
+}
+
+}  // namespace clouds
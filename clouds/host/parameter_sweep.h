@@ -0,0 +1,101 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Points of a parameter sweep: the Cartesian grid, or a Latin hypercube
+// sample, of a set of knob values and playback modes. Axes are given as
+// "knob=values", with values being either:
+//
+//   0.5                   (a single value)
+//   0.1,0.4,0.8           (a list)
+//   0:1:5                 (5 evenly spaced values from 0 to 1)
+//   0:1                   (a range, for Latin hypercube sampling only)
+//
+// In a Latin hypercube, ranges are sampled continuously and lists (and the
+// playback modes) are stratified.
+
+#ifndef CLOUDS_HOST_PARAMETER_SWEEP_H_
+#define CLOUDS_HOST_PARAMETER_SWEEP_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+#include "clouds/dsp/granular_processor.h"
+
+namespace clouds {
+
+// Grids larger than this are rejected.
+const size_t kMaxSweepPoints = 1 << 20;
+
+struct SweepAxis {
+  AutomationTarget target;
+  bool range;
+  float minimum;
+  float maximum;
+  std::vector<float> values;
+};
+
+struct SweepPoint {
+  PlaybackMode playback_mode;
+  std::vector<float> values;  // One per axis.
+};
+
+class ParameterSweep {
+ public:
+  ParameterSweep() { }
+  ~ParameterSweep() { }
+  
+  void Init();
+  
+  // Return false, after printing an error message, on an invalid
+  // specification.
+  bool AddAxis(const char* specification);
+  bool SetPlaybackModes(const char* list);
+  bool BuildGrid(std::vector<SweepPoint>* points) const;
+  
+  void BuildLatinHypercube(
+      size_t num_points,
+      uint32_t seed,
+      std::vector<SweepPoint>* points) const;
+  
+  // Knob changes, at frame 0, moving the knobs to the point.
+  void GetEvents(
+      const SweepPoint& point,
+      std::vector<AutomationEvent>* events) const;
+  
+  inline size_t num_axes() const { return axes_.size(); }
+  inline const SweepAxis& axis(size_t i) const { return axes_[i]; }
+  
+ private:
+  std::vector<SweepAxis> axes_;
+  std::vector<PlaybackMode> playback_modes_;
+  
+  DISALLOW_COPY_AND_ASSIGN(ParameterSweep);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_PARAMETER_SWEEP_H_
@@ -0,0 +1,207 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Two-thread pipeline around a GranularProcessor.
+
+#include "clouds/host/pipelined_processor.h"
+
+#include <algorithm>
+
+namespace clouds {
+
+using namespace std;
+
+bool PipelinedProcessor::Init(GranularProcessor* processor) {
+  processor_ = processor;
+  for (int32_t i = 0; i < 2; ++i) {
+    slots_[i].block.Init();
+  }
+  next_slot_ = 0;
+  in_flight_ = NULL;
+  finished_ = NULL;
+  pending_.Init();
+  queueing_ = false;
+  queue_size_ = 0;
+  fill(&queue_input_[0].l, &queue_input_[0].l + 2 * kMaxBlockSize, 0);
+  fill(&queue_output_[0].l, &queue_output_[0].l + 2 * kMaxBlockSize, 0);
+  num_queued_events_ = 0;
+  
+  running_ = true;
+  sem_init(&wake_up_, 0, 0);
+  sem_init(&done_, 0, 0);
+  if (pthread_create(&thread_, NULL, &WorkerThread, this)) {
+    running_ = false;
+    sem_destroy(&wake_up_);
+    sem_destroy(&done_);
+    return false;
+  }
+  return true;
+}
+
+void PipelinedProcessor::Stop() {
+  if (!__atomic_load_n(&running_, __ATOMIC_RELAXED)) {
+    return;
+  }
+  __atomic_store_n(&running_, false, __ATOMIC_RELAXED);
+  sem_post(&wake_up_);
+  pthread_join(thread_, NULL);
+  sem_destroy(&wake_up_);
+  sem_destroy(&done_);
+}
+
+/* static */
+void* PipelinedProcessor::WorkerThread(void* self) {
+  static_cast<PipelinedProcessor*>(self)->Work();
+  return NULL;
+}
+
+void PipelinedProcessor::Work() {
+  while (true) {
+    sem_wait(&wake_up_);
+    Slot* slot;
+    while (pending_.Pop(&slot)) {
+      processor_->ProcessPost(&slot->block, slot->output);
+      sem_post(&done_);
+    }
+    if (!__atomic_load_n(&running_, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+}
+
+void PipelinedProcessor::Drain() {
+  if (in_flight_) {
+    sem_wait(&done_);
+    finished_ = in_flight_;
+    in_flight_ = NULL;
+  }
+}
+
+void PipelinedProcessor::Prepare() {
+  if (!processor_->stable()) {
+    Drain();
+  }
+  processor_->Prepare();
+}
+
+void PipelinedProcessor::Process(
+    ShortFrame* input,
+    ShortFrame* output,
+    size_t size,
+    const AutomationEvent* events,
+    size_t num_events) {
+  if (size % kMaxBlockSize) {
+    queueing_ = true;
+  }
+  if (queueing_) {
+    ProcessQueued(input, output, size, events, num_events);
+    return;
+  }
+  for (size_t start = 0; start < size; start += kMaxBlockSize) {
+    if (start) {
+      Prepare();
+    }
+    size_t n = ProcessBlock(
+        input + start, output + start, start, events, num_events);
+    events += n;
+    num_events -= n;
+  }
+}
+
+void PipelinedProcessor::ProcessQueued(
+    ShortFrame* input,
+    ShortFrame* output,
+    size_t size,
+    const AutomationEvent* events,
+    size_t num_events) {
+  size_t done = 0;
+  while (done < size) {
+    size_t n = min(size - done, kMaxBlockSize - queue_size_);
+    copy(&input[done], &input[done + n], &queue_input_[queue_size_]);
+    copy(
+        &queue_output_[queue_size_], &queue_output_[queue_size_ + n],
+        &output[done]);
+    while (num_events && events->offset < done + n) {
+      AutomationEvent e = *events++;
+      --num_events;
+      e.offset += queue_size_ - done;
+      QueueEvent(e);
+    }
+    if (queue_size_ + n < kMaxBlockSize) {
+      queue_size_ += n;
+      return;
+    }
+    if (done) {
+      Prepare();
+    }
+    done += n;
+    ProcessBlock(
+        queue_input_, queue_output_, 0, queued_events_, num_queued_events_);
+    num_queued_events_ = 0;
+    queue_size_ = 0;
+  }
+}
+
+void PipelinedProcessor::QueueEvent(const AutomationEvent& event) {
+  // Only the last change of a parameter, and the first trigger, of a block
+  // have an effect.
+  for (size_t i = 0; i < num_queued_events_; ++i) {
+    if (queued_events_[i].target == event.target) {
+      if (event.target != AUTOMATION_TRIGGER) {
+        queued_events_[i] = event;
+      }
+      return;
+    }
+  }
+  queued_events_[num_queued_events_++] = event;
+}
+
+size_t PipelinedProcessor::ProcessBlock(
+    ShortFrame* input,
+    ShortFrame* output,
+    size_t start,
+    const AutomationEvent* events,
+    size_t num_events) {
+  // Run the engine on this block while the worker finishes the previous one.
+  Slot* slot = &slots_[next_slot_];
+  next_slot_ ^= 1;
+  size_t n = processor_->ProcessEngine(
+      input, kMaxBlockSize, start, events, num_events, &slot->block);
+  
+  Drain();
+  if (finished_) {
+    copy(&finished_->output[0], &finished_->output[kMaxBlockSize], output);
+  } else {
+    fill(&output[0].l, &output[0].l + 2 * kMaxBlockSize, 0);
+  }
+  
+  pending_.Push(slot);
+  sem_post(&wake_up_);
+  in_flight_ = slot;
+  return n;
+}
+
+}  // namespace clouds
@@ -0,0 +1,145 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Runs the playback engine of a GranularProcessor on the calling thread, and
+// its post-processing chain (diffuser, pitch-shifter, filters, reverb, dry/wet)
+// on a worker thread, one block behind. Host builds only.
+//
+// This adds kMaxBlockSize frames of latency. The feedback path is also one
+// block longer: while the worker renders block k, the engine already reads
+// block k + 1, which thus gets the output of block k - 1 as feedback. With the
+// feedback at 0, the output is the one of GranularProcessor::Process()
+// delayed by latency() frames; otherwise the feedback loop is 1ms longer at
+// 32kHz, which is why the pipeline is opt-in (clouds_render -p,
+// clouds_set_pipelined()).
+
+#ifndef CLOUDS_HOST_PIPELINED_PROCESSOR_H_
+#define CLOUDS_HOST_PIPELINED_PROCESSOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "clouds/dsp/control_channel.h"
+#include "clouds/dsp/granular_processor.h"
+
+namespace clouds {
+
+class PipelinedProcessor {
+ public:
+  PipelinedProcessor() { }
+  ~PipelinedProcessor() { }
+  
+  // Starts the worker thread. Returns false if it cannot be created.
+  bool Init(GranularProcessor* processor);
+  void Stop();
+  
+  // The output is delayed by latency() frames. As with
+  // GranularProcessor::Process(), from the first size which is not a
+  // multiple of kMaxBlockSize on, the frames are queued until they make a
+  // whole block, which adds one more block of latency.
+  void Process(
+      ShortFrame* input,
+      ShortFrame* output,
+      size_t size,
+      const AutomationEvent* events,
+      size_t num_events);
+  
+  inline void Process(ShortFrame* input, ShortFrame* output, size_t size) {
+    Process(input, output, size, NULL, 0);
+  }
+  
+  // To be called instead of GranularProcessor::Prepare(). When the processor
+  // is about to be reconfigured, it first waits for the worker to be done.
+  void Prepare();
+  
+  // Blocks until the worker is done with the block in flight. To be called
+  // before changing the settings of the processor, other than its parameters.
+  void Drain();
+  
+  inline size_t latency() const {
+    return queueing_ ? 2 * kMaxBlockSize : kMaxBlockSize;
+  }
+  
+ private:
+  struct Slot {
+    ProcessingBlock block;
+    ShortFrame output[kMaxBlockSize];
+  };
+  
+  static void* WorkerThread(void* self);
+  void Work();
+  // Returns the number of events applied to the block.
+  size_t ProcessBlock(
+      ShortFrame* input,
+      ShortFrame* output,
+      size_t start,
+      const AutomationEvent* events,
+      size_t num_events);
+  void ProcessQueued(
+      ShortFrame* input,
+      ShortFrame* output,
+      size_t size,
+      const AutomationEvent* events,
+      size_t num_events);
+  void QueueEvent(const AutomationEvent& event);
+  
+  GranularProcessor* processor_;
+  
+  // Each slot is reused every other block: by then, the post-processing of
+  // the previous block that used it - whose output is fed back - is done.
+  Slot slots_[2];
+  int32_t next_slot_;
+  
+  // The block handed to the worker, and the last one it is done with.
+  Slot* in_flight_;
+  Slot* finished_;
+  
+  SpscQueue<Slot*, 4> pending_;
+  
+  // Partial block, and the changes which fall in it - offsets relative to
+  // its first frame.
+  bool queueing_;
+  size_t queue_size_;
+  ShortFrame queue_input_[kMaxBlockSize];
+  ShortFrame queue_output_[kMaxBlockSize];
+  AutomationEvent queued_events_[kNumAutomationTargets];
+  size_t num_queued_events_;
+  
+  // Posted by the caller when a block is pending, and by the worker when it
+  // is done with one.
+  sem_t wake_up_;
+  sem_t done_;
+  bool running_;
+  pthread_t thread_;
+  
+  DISALLOW_COPY_AND_ASSIGN(PipelinedProcessor);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_PIPELINED_PROCESSOR_H_
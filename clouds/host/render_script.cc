@@ -0,0 +1,278 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Settings and automation of an offline rendering.
+
+#include "clouds/host/render_script.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace clouds {
+
+using namespace std;
+
+static const char* playback_mode_names[] = {
+  "granular",
+  "stretch",
+  "looping_delay",
+  "spectral",
+  "oliverb",
+  "resonestor"
+};
+
+static const char* target_names[] = {
+  "position",
+  "size",
+  "pitch",
+  "density",
+  "texture",
+  "dry_wet",
+  "stereo_spread",
+  "feedback",
+  "reverb",
+  "freeze",
+  "gate",
+  "trigger"
+};
+
+bool ParsePlaybackMode(const char* name, PlaybackMode* playback_mode) {
+  for (int32_t i = 0; i < PLAYBACK_MODE_LAST; ++i) {
+    if (!strcmp(name, playback_mode_names[i])) {
+      *playback_mode = static_cast<PlaybackMode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseAutomationTarget(const char* name, AutomationTarget* target) {
+  for (int32_t i = 0; i <= AUTOMATION_TRIGGER; ++i) {
+    if (!strcmp(name, target_names[i])) {
+      *target = static_cast<AutomationTarget>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseSrcFilter(int32_t num_taps, int32_t* src_filter) {
+  static const int32_t sizes[] = {
+    SRC_FILTER_1X_2_31_SIZE,
+    SRC_FILTER_1X_2_45_SIZE,
+    SRC_FILTER_1X_2_63_SIZE,
+    SRC_FILTER_1X_2_91_SIZE
+  };
+  for (int32_t i = SRC_FILTER_1X_2_31; i <= SRC_FILTER_1X_2_91; ++i) {
+    if (num_taps == sizes[i]) {
+      *src_filter = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* PlaybackModeName(PlaybackMode playback_mode) {
+  return playback_mode_names[playback_mode];
+}
+
+const char* AutomationTargetName(AutomationTarget target) {
+  return target_names[target];
+}
+
+void SetDefaultKnobs(Parameters* parameters) {
+  parameters->position = 0.0f;
+  parameters->size = 0.5f;
+  parameters->pitch = 0.0f;
+  parameters->density = 0.5f;
+  parameters->texture = 0.5f;
+  parameters->dry_wet = 1.0f;
+  parameters->stereo_spread = 0.0f;
+  parameters->feedback = 0.0f;
+  parameters->reverb = 0.0f;
+}
+
+static bool CompareBreakpoints(const Breakpoint& a, const Breakpoint& b) {
+  return a.time < b.time;
+}
+
+void RenderScript::Init() {
+  playback_mode_ = PLAYBACK_MODE_GRANULAR;
+  quality_ = 0;
+  src_filter_ = SRC_FILTER_1X_2_45;
+  engine_rate_ = 0;
+  seed_ = kDefaultRandomSeed;
+  tail_ = 0.0f;
+  for (int32_t i = 0; i < AUTOMATION_TRIGGER; ++i) {
+    curves_[i].clear();
+  }
+  triggers_.clear();
+}
+
+bool RenderScript::Load(const char* file_name) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    fprintf(stderr, "%s: cannot open file\n", file_name);
+    return false;
+  }
+  char line[256];
+  int32_t line_number = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    char* comment = strchr(line, '#');
+    if (comment) {
+      *comment = '\0';
+    }
+    if (!Parse(line)) {
+      fprintf(stderr, "%s:%d: syntax error: %s", file_name, line_number, line);
+      ok = false;
+    }
+  }
+  fclose(fp);
+  
+  // Breakpoints can be listed in any order.
+  for (int32_t i = 0; i < AUTOMATION_TRIGGER; ++i) {
+    stable_sort(curves_[i].begin(), curves_[i].end(), CompareBreakpoints);
+  }
+  sort(triggers_.begin(), triggers_.end());
+  return ok;
+}
+
+bool RenderScript::Parse(const char* line) {
+  char word[32];
+  char name[32];
+  double time;
+  float value;
+  int32_t integer;
+  int32_t n;
+  
+  if (sscanf(line, " %31s %n", word, &n) != 1) {
+    return true;  // Empty line.
+  }
+  
+  if (!strcmp(word, "mode")) {
+    return sscanf(line + n, "%31s", name) == 1 &&
+        ParsePlaybackMode(name, &playback_mode_);
+  } else if (!strcmp(word, "quality")) {
+    if (sscanf(line + n, "%d", &integer) != 1 || integer < 0 ||
+        integer >= kNumQualities) {
+      return false;
+    }
+    quality_ = integer;
+    return true;
+  } else if (!strcmp(word, "src_filter")) {
+    return sscanf(line + n, "%d", &integer) == 1 &&
+        ParseSrcFilter(integer, &src_filter_);
+  } else if (!strcmp(word, "engine_rate")) {
+    return sscanf(line + n, "%d", &engine_rate_) == 1 && engine_rate_ >= 0;
+  } else if (!strcmp(word, "seed")) {
+    return sscanf(line + n, "%u", &seed_) == 1;
+  } else if (!strcmp(word, "tail")) {
+    return sscanf(line + n, "%f", &tail_) == 1 && tail_ >= 0.0f;
+  }
+  
+  // Breakpoint.
+  char* end;
+  time = strtod(word, &end);
+  if (*end || time < 0.0f) {
+    return false;
+  }
+  int32_t num_fields = sscanf(line + n, "%31s %f", name, &value);
+  if (num_fields < 1) {
+    return false;
+  }
+  AutomationTarget target;
+  if (!ParseAutomationTarget(name, &target)) {
+    return false;
+  }
+  if (target == AUTOMATION_TRIGGER) {
+    triggers_.push_back(time);
+    return num_fields == 1;
+  } else if (num_fields != 2) {
+    return false;
+  }
+  Breakpoint b = { time, value };
+  curves_[target].push_back(b);
+  return true;
+}
+
+float RenderScript::Evaluate(AutomationTarget target, double time) const {
+  const vector<Breakpoint>& curve = curves_[target];
+  bool step = target == AUTOMATION_FREEZE || target == AUTOMATION_GATE;
+  
+  size_t i = 0;
+  while (i < curve.size() && curve[i].time <= time) {
+    ++i;
+  }
+  if (i == 0) {
+    return curve.front().value;
+  } else if (i == curve.size() || step) {
+    return curve[i - 1].value;
+  }
+  const Breakpoint& a = curve[i - 1];
+  const Breakpoint& b = curve[i];
+  return a.value + (b.value - a.value) * static_cast<float>(
+      (time - a.time) / (b.time - a.time));
+}
+
+void RenderScript::GetEvents(
+    size_t start,
+    size_t size,
+    float sample_rate,
+    vector<AutomationEvent>* events) const {
+  // Triggers are rounded to the nearest frame.
+  vector<double>::const_iterator trigger = lower_bound(
+      triggers_.begin(), triggers_.end(), (start - 0.5) / sample_rate);
+  for (size_t offset = 0; offset < size; offset += kMaxBlockSize) {
+    double time = (start + offset) / static_cast<double>(sample_rate);
+    for (int32_t i = 0; i < AUTOMATION_TRIGGER; ++i) {
+      if (!curves_[i].empty()) {
+        AutomationTarget target = static_cast<AutomationTarget>(i);
+        AutomationEvent e = { offset, target, Evaluate(target, time) };
+        events->push_back(e);
+      }
+    }
+    
+    size_t block_end = min(offset + kMaxBlockSize, size);
+    while (trigger != triggers_.end()) {
+      size_t frame = static_cast<size_t>(*trigger * sample_rate + 0.5);
+      if (frame >= start + block_end) {
+        break;
+      }
+      if (frame >= start + offset) {
+        AutomationEvent e = { frame - start, AUTOMATION_TRIGGER, 1.0f };
+        events->push_back(e);
+      }
+      ++trigger;
+    }
+  }
+}
+
+}  // namespace clouds
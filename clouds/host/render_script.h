@@ -0,0 +1,120 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Settings and automation of an offline rendering. A script is a text file
+// with one statement per line, "#" starting a comment:
+//
+//   mode granular         (stretch, looping_delay, spectral, oliverb,
+//                          resonestor)
+//   quality 0             (0 to 5, as in the firmware)
+//   src_filter 45         (taps of the low fidelity resampling filter: 31,
+//                          45, 63 or 91)
+//   engine_rate 32000     (runs the engine at this rate, converting the audio
+//                          from and to the rate of the host; 0 for none)
+//   seed 1234             (of the random generator)
+//   tail 4.0              (seconds of silence rendered after the input)
+//   0.0 position 0.2      (time in seconds, parameter, value)
+//   8.0 position 0.9
+//   2.5 trigger
+//
+// Knobs (position, size, pitch, density, texture, dry_wet, stereo_spread,
+// feedback, reverb) are interpolated linearly between their breakpoints.
+// freeze and gate hold the value of their last breakpoint.
+
+#ifndef CLOUDS_HOST_RENDER_SCRIPT_H_
+#define CLOUDS_HOST_RENDER_SCRIPT_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+#include "clouds/dsp/granular_processor.h"
+
+namespace clouds {
+
+// Names used in scripts and on the command line of the host tools.
+bool ParsePlaybackMode(const char* name, PlaybackMode* playback_mode);
+bool ParseAutomationTarget(const char* name, AutomationTarget* target);
+const char* PlaybackModeName(PlaybackMode playback_mode);
+const char* AutomationTargetName(AutomationTarget target);
+
+// From a number of taps to SRC_FILTER_1X_2_31...91.
+bool ParseSrcFilter(int32_t num_taps, int32_t* src_filter);
+
+// Knob positions of an offline rendering, before any automation.
+void SetDefaultKnobs(Parameters* parameters);
+
+struct Breakpoint {
+  double time;
+  float value;
+};
+
+class RenderScript {
+ public:
+  RenderScript() { }
+  ~RenderScript() { }
+  
+  void Init();
+  
+  // Returns false, after printing the offending line, on a syntax error.
+  bool Load(const char* file_name);
+  
+  // Appends the automation of the frames [start, start + size) to events,
+  // with offsets relative to start: the knobs, at the beginning of each block
+  // of kMaxBlockSize frames, and the triggers at their exact frame.
+  void GetEvents(
+      size_t start,
+      size_t size,
+      float sample_rate,
+      std::vector<AutomationEvent>* events) const;
+  
+  inline PlaybackMode playback_mode() const { return playback_mode_; }
+  inline int32_t quality() const { return quality_; }
+  inline int32_t src_filter() const { return src_filter_; }
+  inline int32_t engine_rate() const { return engine_rate_; }
+  inline uint32_t seed() const { return seed_; }
+  inline float tail() const { return tail_; }
+  
+ private:
+  bool Parse(const char* line);
+  float Evaluate(AutomationTarget target, double time) const;
+  
+  PlaybackMode playback_mode_;
+  int32_t quality_;
+  int32_t src_filter_;
+  int32_t engine_rate_;
+  uint32_t seed_;
+  float tail_;
+  
+  std::vector<Breakpoint> curves_[AUTOMATION_TRIGGER];
+  std::vector<double> triggers_;
+  
+  DISALLOW_COPY_AND_ASSIGN(RenderScript);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_RENDER_SCRIPT_H_
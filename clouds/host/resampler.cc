@@ -0,0 +1,198 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Streaming sample rate converter.
+
+#include "clouds/host/resampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+  #define CLOUDS_RESAMPLER_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  #include <arm_neon.h>
+  #define CLOUDS_RESAMPLER_NEON
+#endif
+
+namespace clouds {
+
+using namespace std;
+
+// Input frames added to the history at once.
+const int32_t kResamplerBlockSize = 256;
+
+// Cutoff, relative to the lower Nyquist frequency, and shape of the window.
+const double kResamplerCutoff = 0.915;
+const double kResamplerBeta = 9.5;
+
+static int32_t Gcd(int32_t a, int32_t b) {
+  while (b) {
+    int32_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// Modified Bessel function of the first kind, order 0.
+static double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int32_t k = 1; term > sum * 1e-12; ++k) {
+    double y = x / (2.0 * k);
+    term *= y * y;
+    sum += term;
+  }
+  return sum;
+}
+
+bool Resampler::Init(int32_t input_rate, int32_t output_rate) {
+  if (input_rate <= 0 || output_rate <= 0) {
+    return false;
+  }
+  int32_t gcd = Gcd(input_rate, output_rate);
+  num_ = input_rate / gcd;
+  den_ = output_rate / gcd;
+  if (den_ > kResamplerMaxPhases) {
+    return false;
+  }
+  
+  // When decimating, the filter is stretched to the lower output rate.
+  double scale = min(1.0, static_cast<double>(den_) / num_);
+  int32_t half_length = static_cast<int32_t>(
+      ceil(kResamplerHalfLength / scale - 1e-9));
+  num_taps_ = 2 * half_length;
+  
+  coefficients_.resize(den_ * num_taps_);
+  const double pi = 3.14159265358979323846;
+  double window_scale = 1.0 / BesselI0(kResamplerBeta);
+  for (int32_t p = 0; p < den_; ++p) {
+    float* h = &coefficients_[p * num_taps_];
+    double sum = 0.0;
+    vector<double> taps(num_taps_);
+    for (int32_t i = 0; i < num_taps_; ++i) {
+      // Distance from the tap to the output, in periods of the lower rate.
+      double t = (half_length - 1 - i + static_cast<double>(p) / den_) * scale;
+      double u = t / kResamplerHalfLength;
+      double window = u * u < 1.0
+          ? BesselI0(kResamplerBeta * sqrt(1.0 - u * u)) * window_scale
+          : 0.0;
+      double x = pi * kResamplerCutoff * t;
+      double sinc = x == 0.0 ? 1.0 : sin(x) / x;
+      taps[i] = sinc * window;
+      sum += taps[i];
+    }
+    // Unity gain at DC for each phase.
+    for (int32_t i = 0; i < num_taps_; ++i) {
+      h[i] = static_cast<float>(taps[i] / sum);
+    }
+  }
+  
+  history_size_ = num_taps_ - 1 + kResamplerBlockSize;
+  history_.assign(2 * history_size_, 0.0f);
+  write_ptr_ = num_taps_ - 1;
+  position_ = num_taps_ - 1;
+  phase_ = 0;
+  return true;
+}
+
+inline void Resampler::Convolve(
+    const float* x,
+    const float* h,
+    float* y) const {
+#if defined(CLOUDS_RESAMPLER_SSE2)
+  __m128 sum = _mm_setzero_ps();
+  for (int32_t k = 0; k < num_taps_; k += 2) {
+    __m128 c = _mm_castpd_ps(_mm_load_sd((const double*) (h + k)));
+    c = _mm_unpacklo_ps(c, c);
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(x + 2 * k), c));
+  }
+  float s[4];
+  _mm_storeu_ps(s, sum);
+#elif defined(CLOUDS_RESAMPLER_NEON)
+  float32x4_t sum = vdupq_n_f32(0.0f);
+  for (int32_t k = 0; k < num_taps_; k += 2) {
+    float32x2x2_t c = vzip_f32(vld1_f32(h + k), vld1_f32(h + k));
+    float32x4_t coefficients = vcombine_f32(c.val[0], c.val[1]);
+    sum = vaddq_f32(sum, vmulq_f32(vld1q_f32(x + 2 * k), coefficients));
+  }
+  float s[4];
+  vst1q_f32(s, sum);
+#else
+  float s[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for (int32_t k = 0; k < num_taps_; k += 2) {
+    s[0] += x[2 * k] * h[k];
+    s[1] += x[2 * k + 1] * h[k];
+    s[2] += x[2 * k + 2] * h[k + 1];
+    s[3] += x[2 * k + 3] * h[k + 1];
+  }
+#endif  // CLOUDS_RESAMPLER_SSE2
+  y[0] = s[0] + s[2];
+  y[1] = s[1] + s[3];
+}
+
+size_t Resampler::Process(const float* in, float* out, size_t size) {
+  const int32_t step = num_ / den_;
+  const int32_t step_phase = num_ % den_;
+  size_t num_written = 0;
+  while (size) {
+    if (write_ptr_ == history_size_) {
+      // Keep the frames needed by the next output.
+      int32_t start = position_ - num_taps_ + 1;
+      copy(
+          &history_[2 * start],
+          &history_[2 * write_ptr_],
+          &history_[0]);
+      write_ptr_ -= start;
+      position_ -= start;
+    }
+    size_t n = min(size, static_cast<size_t>(history_size_ - write_ptr_));
+    copy(&in[0], &in[2 * n], &history_[2 * write_ptr_]);
+    write_ptr_ += n;
+    in += 2 * n;
+    size -= n;
+    
+    while (position_ < write_ptr_) {
+      Convolve(
+          &history_[2 * (position_ - num_taps_ + 1)],
+          &coefficients_[phase_ * num_taps_],
+          out);
+      out += 2;
+      ++num_written;
+      position_ += step;
+      phase_ += step_phase;
+      if (phase_ >= den_) {
+        phase_ -= den_;
+        ++position_;
+      }
+    }
+  }
+  return num_written;
+}
+
+}  // namespace clouds
@@ -0,0 +1,105 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Streaming sample rate converter for stereo audio, between any two integer
+// rates. Host builds only.
+//
+// The ratio of the rates is reduced to a fraction, and each output frame is
+// a Kaiser-windowed sinc interpolation of the input frames around it, with
+// one set of coefficients per fractional position: there is no
+// interpolation between table entries, and no drift. The filter spans
+// kResamplerHalfLength periods of the lower rate on each side. It is flat up
+// to 85% of the lower Nyquist frequency, and attenuates by about 95dB above
+// it.
+//
+// The history is a linear buffer of interleaved frames, copied down when
+// full. With SSE2 or NEON, the left and right channels of two consecutive
+// taps are computed in the lanes of a vector; the scalar code sums the even
+// and odd taps separately, in the same order, so the results are the same.
+
+#ifndef CLOUDS_HOST_RESAMPLER_H_
+#define CLOUDS_HOST_RESAMPLER_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+namespace clouds {
+
+const int32_t kResamplerHalfLength = 40;
+
+// Largest number of sets of coefficients, that is of the denominator of the
+// reduced ratio: 1280 for 11025Hz to 32kHz.
+const int32_t kResamplerMaxPhases = 2048;
+
+class Resampler {
+ public:
+  Resampler() { }
+  ~Resampler() { }
+  
+  // Returns false if a rate is not positive, or if the ratio needs more than
+  // kResamplerMaxPhases sets of coefficients. Also clears the history.
+  bool Init(int32_t input_rate, int32_t output_rate);
+  
+  // Converts size interleaved stereo frames. Returns the number of frames
+  // written to out, at most max_output_size(size).
+  size_t Process(const float* in, float* out, size_t size);
+  
+  inline size_t max_output_size(size_t input_size) const {
+    return input_size * den_ / num_ + 1;
+  }
+  
+  // Constant delay of the output, in input frames.
+  inline float delay() const {
+    return static_cast<float>(num_taps_ / 2);
+  }
+  
+ private:
+  inline void Convolve(const float* x, const float* h, float* y) const;
+  
+  // Output frames are num_ / den_ input frames apart.
+  int32_t num_;
+  int32_t den_;
+  int32_t num_taps_;
+  
+  // den_ rows of num_taps_ coefficients.
+  std::vector<float> coefficients_;
+  
+  std::vector<float> history_;
+  int32_t history_size_;
+  int32_t write_ptr_;
+  
+  // Last frame of the window of the next output, and its fractional position
+  // in 1/den_ of a frame.
+  int32_t position_;
+  int32_t phase_;
+  
+  DISALLOW_COPY_AND_ASSIGN(Resampler);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_RESAMPLER_H_
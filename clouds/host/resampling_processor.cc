@@ -0,0 +1,153 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// GranularProcessor running at its own sample rate.
+
+#include "clouds/host/resampling_processor.h"
+
+#include <algorithm>
+
+#include "clouds/dsp/sample_conversion.h"
+
+namespace clouds {
+
+using namespace std;
+
+// Host frames converted at once.
+const size_t kResamplingChunkSize = 256;
+
+bool ResamplingProcessor::Init(
+    GranularProcessor* processor,
+    int32_t host_sample_rate,
+    int32_t engine_sample_rate) {
+  if (!down_.Init(host_sample_rate, engine_sample_rate) ||
+      !up_.Init(engine_sample_rate, host_sample_rate)) {
+    return false;
+  }
+  processor_ = processor;
+  processor_->set_sample_rate(engine_sample_rate);
+  host_sample_rate_ = host_sample_rate;
+  engine_sample_rate_ = engine_sample_rate;
+  
+  // The output lags by up to one engine block, converted to host frames.
+  size_t num_primed = (static_cast<int64_t>(kMaxBlockSize) * host_sample_rate +
+      engine_sample_rate - 1) / engine_sample_rate;
+  latency_ = down_.delay() + host_frames(up_.delay()) + num_primed;
+  
+  size_t max_engine_input = kMaxBlockSize + down_.max_output_size(
+      kResamplingChunkSize);
+  size_t max_host_output = num_primed + kResamplingChunkSize +
+      (max_engine_input / kMaxBlockSize + 1) * up_.max_output_size(
+          kMaxBlockSize);
+  engine_input_.assign(2 * max_engine_input, 0.0f);
+  engine_input_size_ = 0;
+  host_output_.assign(2 * max_host_output, 0.0f);
+  host_output_size_ = num_primed;
+  host_input_.resize(2 * kResamplingChunkSize);
+  
+  pending_events_.clear();
+  pending_events_.reserve(64);
+  num_host_frames_ = 0;
+  num_engine_frames_ = 0;
+  return true;
+}
+
+void ResamplingProcessor::Process(
+    const ShortFrame* input,
+    ShortFrame* output,
+    size_t size,
+    const AutomationEvent* events,
+    size_t num_events) {
+  for (size_t start = 0; start < size; ) {
+    size_t n = min(size - start, kResamplingChunkSize);
+    
+    // The audio of a host frame reaches the engine down_.delay() frames
+    // later. Events are moved with it.
+    for (; num_events && events->offset < start + n; ++events, --num_events) {
+      AutomationEvent e = *events;
+      double host_frame = static_cast<double>(
+          num_host_frames_ + e.offset - start) + down_.delay();
+      e.offset = static_cast<size_t>(
+          host_frame * engine_sample_rate_ / host_sample_rate_ + 0.5);
+      pending_events_.push_back(e);
+    }
+    
+    ShortToFloat(&input[start].l, &host_input_[0], 1, 2 * n, 1.0f / 32768.0f);
+    engine_input_size_ += down_.Process(
+        &host_input_[0], &engine_input_[2 * engine_input_size_], n);
+    size_t consumed = 0;
+    for (; engine_input_size_ - consumed >= kMaxBlockSize;
+         consumed += kMaxBlockSize) {
+      ProcessBlock(&engine_input_[2 * consumed]);
+    }
+    copy(
+        &engine_input_[2 * consumed],
+        &engine_input_[2 * engine_input_size_],
+        &engine_input_[0]);
+    engine_input_size_ -= consumed;
+    
+    FloatToShort(&host_output_[0], 1, &output[start].l, 2 * n, 32768.0f);
+    copy(
+        &host_output_[2 * n],
+        &host_output_[2 * host_output_size_],
+        &host_output_[0]);
+    host_output_size_ -= n;
+    
+    num_host_frames_ += n;
+    start += n;
+  }
+}
+
+void ResamplingProcessor::ProcessBlock(const float* input) {
+  FloatToShort(input, 1, &block_input_[0].l, 2 * kMaxBlockSize, 32768.0f);
+  
+  size_t num_events = 0;
+  size_t end = num_engine_frames_ + kMaxBlockSize;
+  for (; num_events < pending_events_.size() &&
+         pending_events_[num_events].offset < end; ++num_events) {
+    AutomationEvent* e = &pending_events_[num_events];
+    e->offset = e->offset > num_engine_frames_
+        ? e->offset - num_engine_frames_
+        : 0;
+  }
+  processor_->Process(
+      block_input_, block_output_, kMaxBlockSize,
+      num_events ? &pending_events_[0] : NULL, num_events);
+  processor_->Prepare();
+  pending_events_.erase(
+      pending_events_.begin(),
+      pending_events_.begin() + num_events);
+  num_engine_frames_ += kMaxBlockSize;
+  
+  ShortToFloat(
+      &block_output_[0].l, block_output_float_, 1, 2 * kMaxBlockSize,
+      1.0f / 32768.0f);
+  host_output_size_ += up_.Process(
+      block_output_float_, &host_output_[2 * host_output_size_],
+      kMaxBlockSize);
+}
+
+}  // namespace clouds
@@ -0,0 +1,119 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Runs a GranularProcessor at a sample rate of its own - typically the 32kHz
+// of the module, at which its buffers last as long and its effects sound the
+// same - for a host running at another rate. The audio is converted to the
+// engine rate and back by two Resamplers. Host builds only.
+//
+// The engine is fed blocks of kMaxBlockSize frames, whatever the size of the
+// host buffers, so the output does not depend on them. The output is delayed
+// by latency() host frames: the delays of the two filters, plus one engine
+// block, so that an output frame is always ready when the host asks for it.
+
+#ifndef CLOUDS_HOST_RESAMPLING_PROCESSOR_H_
+#define CLOUDS_HOST_RESAMPLING_PROCESSOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+#include "clouds/dsp/granular_processor.h"
+#include "clouds/host/resampler.h"
+
+namespace clouds {
+
+class ResamplingProcessor {
+ public:
+  ResamplingProcessor() { }
+  ~ResamplingProcessor() { }
+  
+  // Also sets the sample rate of the processor. Returns false if the ratio of
+  // the rates is not supported by Resampler.
+  bool Init(
+      GranularProcessor* processor,
+      int32_t host_sample_rate,
+      int32_t engine_sample_rate);
+  
+  // Any number of frames, at the host rate; the offsets of the events are in
+  // host frames. Calls Prepare() on the processor after each engine block.
+  void Process(
+      const ShortFrame* input,
+      ShortFrame* output,
+      size_t size,
+      const AutomationEvent* events,
+      size_t num_events);
+  
+  inline void Process(
+      const ShortFrame* input,
+      ShortFrame* output,
+      size_t size) {
+    Process(input, output, size, NULL, 0);
+  }
+  
+  // In host frames. It is not a whole number of frames in general.
+  inline float latency() const {
+    return latency_;
+  }
+  
+  inline float host_frames(float engine_frames) const {
+    return engine_frames * host_sample_rate_ / engine_sample_rate_;
+  }
+  
+ private:
+  void ProcessBlock(const float* input);
+  
+  GranularProcessor* processor_;
+  Resampler down_;
+  Resampler up_;
+  float host_sample_rate_;
+  float engine_sample_rate_;
+  float latency_;
+  
+  // Engine frames waiting for a full block, and host frames waiting to be
+  // output - interleaved floats.
+  std::vector<float> engine_input_;
+  size_t engine_input_size_;
+  std::vector<float> host_output_;
+  size_t host_output_size_;
+  
+  std::vector<float> host_input_;
+  ShortFrame block_input_[kMaxBlockSize];
+  ShortFrame block_output_[kMaxBlockSize];
+  float block_output_float_[kMaxBlockSize * 2];
+  
+  // Events not applied yet, with their offset counted in engine frames from
+  // the beginning of the stream.
+  std::vector<AutomationEvent> pending_events_;
+  size_t num_host_frames_;
+  size_t num_engine_frames_;
+  
+  DISALLOW_COPY_AND_ASSIGN(ResamplingProcessor);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_RESAMPLING_PROCESSOR_H_
@@ -0,0 +1,351 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Streaming WAV file reader and writer.
+
+#include "clouds/host/wav_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace clouds {
+
+using namespace std;
+
+enum WavFormat {
+  WAV_FORMAT_PCM = 1,
+  WAV_FORMAT_FLOAT = 3,
+  WAV_FORMAT_EXTENSIBLE = 0xfffe
+};
+
+static inline uint32_t ReadLE(const uint8_t* p, size_t num_bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < num_bytes; ++i) {
+    value |= static_cast<uint32_t>(p[i]) << (8 * i);
+  }
+  return value;
+}
+
+static inline uint8_t* WriteLE(uint8_t* p, uint32_t value, size_t num_bytes) {
+  for (size_t i = 0; i < num_bytes; ++i) {
+    *p++ = (value >> (8 * i)) & 0xff;
+  }
+  return p;
+}
+
+bool WavReader::Fail(const char* error) {
+  error_ = error;
+  Close();
+  return false;
+}
+
+bool WavReader::Open(const char* file_name) {
+  Close();
+  error_ = NULL;
+  format_ = 0;
+  fd_ = open(file_name, O_RDONLY);
+  if (fd_ == -1) {
+    return Fail("cannot open file");
+  }
+  struct stat info;
+  if (fstat(fd_, &info) || info.st_size < 12) {
+    return Fail("not a RIFF/WAVE file");
+  }
+  map_size_ = info.st_size;
+  // A private, writable mapping lets callers process the frames in place.
+  void* map = mmap(
+      NULL, map_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd_, 0);
+  if (map == MAP_FAILED) {
+    return Fail("cannot map file");
+  }
+  map_ = static_cast<uint8_t*>(map);
+  madvise(map_, map_size_, MADV_SEQUENTIAL);
+  
+  if (memcmp(&map_[0], "RIFF", 4) || memcmp(&map_[8], "WAVE", 4)) {
+    return Fail("not a RIFF/WAVE file");
+  }
+  
+  // Walk the chunks until the audio data.
+  size_t offset = 12;
+  while (true) {
+    if (map_size_ - offset < 8) {
+      return Fail("no data chunk");
+    }
+    const uint8_t* chunk = &map_[offset];
+    size_t size = ReadLE(&chunk[4], 4);
+    size_t available = map_size_ - offset - 8;
+    if (!memcmp(&chunk[0], "fmt ", 4)) {
+      if (size > available) {
+        return Fail("truncated fmt chunk");
+      }
+      if (!ParseFormat(&chunk[8], size)) {
+        return false;
+      }
+    } else if (!memcmp(&chunk[0], "data", 4)) {
+      if (!format_) {
+        return Fail("data chunk before fmt chunk");
+      }
+      // Files written by streaming recorders often leave a bogus size.
+      if (size > available) {
+        size = available;
+      }
+      data_ = &chunk[8];
+      num_frames_ = size / frame_size_;
+      position_ = 0;
+      native_ = format_ == WAV_FORMAT_PCM && bits_per_sample_ == 16 &&
+          num_channels_ == 2 && !(reinterpret_cast<uintptr_t>(data_) & 1);
+      return true;
+    } else if (size + (size & 1) > available) {
+      return Fail("truncated chunk");
+    }
+    offset += 8 + size + (size & 1);
+  }
+}
+
+bool WavReader::ParseFormat(const uint8_t* fmt, size_t size) {
+  if (size < 16) {
+    return Fail("invalid fmt chunk");
+  }
+  format_ = ReadLE(&fmt[0], 2);
+  num_channels_ = ReadLE(&fmt[2], 2);
+  sample_rate_ = ReadLE(&fmt[4], 4);
+  frame_size_ = ReadLE(&fmt[12], 2);
+  bits_per_sample_ = ReadLE(&fmt[14], 2);
+  if (format_ == WAV_FORMAT_EXTENSIBLE && size >= 26) {
+    // The actual format is in the first bytes of the sub-format GUID.
+    format_ = ReadLE(&fmt[24], 2);
+  }
+  
+  bool pcm = format_ == WAV_FORMAT_PCM && (bits_per_sample_ == 8 ||
+      bits_per_sample_ == 16 || bits_per_sample_ == 24 ||
+      bits_per_sample_ == 32);
+  bool ieee_float = format_ == WAV_FORMAT_FLOAT && bits_per_sample_ == 32;
+  if (!pcm && !ieee_float) {
+    return Fail("unsupported sample format");
+  }
+  if (num_channels_ < 1 ||
+      frame_size_ != static_cast<size_t>(
+          num_channels_ * bits_per_sample_ / 8) ||
+      sample_rate_ <= 0) {
+    return Fail("invalid fmt chunk");
+  }
+  return true;
+}
+
+void WavReader::Close() {
+  if (map_) {
+    munmap(map_, map_size_);
+    map_ = NULL;
+  }
+  if (fd_ != -1) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+size_t WavReader::View(size_t size, const uint8_t** data) {
+  if (!map_) {
+    *data = NULL;
+    return 0;
+  }
+  size = min(size, num_frames_ - position_);
+  *data = data_ + position_ * frame_size_;
+  position_ += size;
+  return size;
+}
+
+size_t WavReader::Read(ShortFrame* buffer, size_t size, ShortFrame** frames) {
+  *frames = buffer;
+  if (!native_) {
+    return Read(buffer, size);
+  }
+  const uint8_t* data;
+  size = View(size, &data);
+  // The mapping is writable, see Open().
+  *frames = reinterpret_cast<ShortFrame*>(const_cast<uint8_t*>(data));
+  return size;
+}
+
+size_t WavReader::Read(ShortFrame* frames, size_t size) {
+  const uint8_t* data;
+  size = View(size, &data);
+  if (native_) {
+    copy(data, data + size * frame_size_, reinterpret_cast<uint8_t*>(frames));
+    return size;
+  }
+  
+  size_t sample_size = bits_per_sample_ / 8;
+  for (size_t i = 0; i < size; ++i) {
+    const uint8_t* p = data + i * frame_size_;
+    int16_t s[2];
+    for (int32_t j = 0; j < 2; ++j) {
+      const uint8_t* q = p + (j < num_channels_ ? j : 0) * sample_size;
+      if (format_ == WAV_FORMAT_FLOAT) {
+        uint32_t word = ReadLE(q, 4);
+        float f;
+        memcpy(&f, &word, 4);
+        f *= 32768.0f;
+        s[j] = f >= 32767.0f ? 32767 : f <= -32768.0f ? -32768 :
+            static_cast<int16_t>(f);
+      } else if (sample_size == 1) {
+        s[j] = static_cast<int16_t>((q[0] - 128) * 256);
+      } else {
+        // Keep the 16 most significant bits.
+        s[j] = static_cast<int16_t>(ReadLE(q + sample_size - 2, 2));
+      }
+    }
+    frames[i].l = s[0];
+    frames[i].r = s[1];
+  }
+  return size;
+}
+
+bool WavWriter::Open(
+    const char* file_name,
+    int32_t sample_rate,
+    int32_t num_channels) {
+  Close();
+  fd_ = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd_ == -1) {
+    return false;
+  }
+  void* buffer;
+  if (posix_memalign(&buffer, 4096, kWavWriteBufferSize)) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  buffer_ = static_cast<uint8_t*>(buffer);
+  sample_rate_ = sample_rate;
+  num_channels_ = num_channels;
+  num_frames_ = 0;
+  error_ = false;
+  // The header occupies the beginning of the first buffer, so that all the
+  // writes but the last one are whole buffers at aligned file offsets. It is
+  // rewritten in Close() once the sizes are known.
+  buffer_level_ = FormatHeader(buffer_);
+  return true;
+}
+
+size_t WavWriter::FormatHeader(uint8_t* header) const {
+  // More than two channels require the extensible format, with no speaker
+  // assigned to the channels.
+  bool extensible = num_channels_ > 2;
+  uint32_t format_size = extensible ? 40 : 16;
+  uint32_t block_align = num_channels_ * sizeof(int16_t);
+  uint32_t data_size = num_frames_ * block_align;
+  uint8_t* p = header;
+  memcpy(p, "RIFF", 4);
+  p = WriteLE(p + 4, 20 + format_size + data_size, 4);
+  memcpy(p, "WAVEfmt ", 8);
+  p = WriteLE(p + 8, format_size, 4);
+  p = WriteLE(p, extensible ? WAV_FORMAT_EXTENSIBLE : WAV_FORMAT_PCM, 2);
+  p = WriteLE(p, num_channels_, 2);
+  p = WriteLE(p, sample_rate_, 4);
+  p = WriteLE(p, sample_rate_ * block_align, 4);
+  p = WriteLE(p, block_align, 2);
+  p = WriteLE(p, 16, 2);
+  if (extensible) {
+    static const uint8_t pcm_guid_tail[] = {
+      0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00,
+      0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+    };
+    p = WriteLE(p, 22, 2);
+    p = WriteLE(p, 16, 2);
+    p = WriteLE(p, 0, 4);
+    p = WriteLE(p, WAV_FORMAT_PCM, 2);
+    memcpy(p, pcm_guid_tail, sizeof(pcm_guid_tail));
+    p += sizeof(pcm_guid_tail);
+  }
+  memcpy(p, "data", 4);
+  p = WriteLE(p + 4, data_size, 4);
+  return p - header;
+}
+
+bool WavWriter::Flush() {
+  const uint8_t* p = buffer_;
+  size_t remaining = buffer_level_;
+  while (remaining && !error_) {
+    ssize_t written = write(fd_, p, remaining);
+    if (written <= 0) {
+      error_ = true;
+    } else {
+      p += written;
+      remaining -= written;
+    }
+  }
+  buffer_level_ = 0;
+  return !error_;
+}
+
+bool WavWriter::Write(const ShortFrame* frames, size_t size) {
+  return WriteSamples(&frames[0].l, size);
+}
+
+bool WavWriter::WriteSamples(const int16_t* samples, size_t num_frames) {
+  // Samples are written as they are in memory: this assumes a little-endian
+  // host.
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(samples);
+  size_t size = num_frames * num_channels_ * sizeof(int16_t);
+  num_frames_ += num_frames;
+  while (size && !error_) {
+    size_t chunk = min(size, kWavWriteBufferSize - buffer_level_);
+    copy(p, p + chunk, buffer_ + buffer_level_);
+    buffer_level_ += chunk;
+    p += chunk;
+    size -= chunk;
+    if (buffer_level_ == kWavWriteBufferSize) {
+      Flush();
+    }
+  }
+  return !error_;
+}
+
+bool WavWriter::Close() {
+  if (fd_ == -1) {
+    return true;
+  }
+  Flush();
+  uint8_t header[80];
+  size_t header_size = FormatHeader(header);
+  if (pwrite(fd_, header, header_size, 0) != static_cast<ssize_t>(
+          header_size)) {
+    error_ = true;
+  }
+  bool ok = close(fd_) == 0 && !error_;
+  fd_ = -1;
+  free(buffer_);
+  buffer_ = NULL;
+  return ok;
+}
+
+}  // namespace clouds
@@ -0,0 +1,138 @@
+// Copyright 2014 Olivier Gillet.
+//
+// Author: Olivier Gillet (ol.gillet@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+// 
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Streaming WAV file reader and writer. The reader maps the file in memory,
+// walks the RIFF chunks and accepts 8, 16, 24 and 32-bit PCM and 32-bit float
+// files, with any number of channels. The writer produces 16-bit PCM, stereo
+// by default, through large page-aligned writes.
+
+#ifndef CLOUDS_HOST_WAV_FILE_H_
+#define CLOUDS_HOST_WAV_FILE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <cstddef>
+
+#include "clouds/dsp/frame.h"
+
+namespace clouds {
+
+const size_t kWavWriteBufferSize = 1 << 20;
+
+class WavReader {
+ public:
+  WavReader() : fd_(-1), map_(NULL) { }
+  ~WavReader() { Close(); }
+  
+  // Returns false, with a message in error(), if the file cannot be read or
+  // is not in a supported format.
+  bool Open(const char* file_name);
+  void Close();
+  
+  // Converts the next frames to 16-bit stereo. Only the first two channels
+  // are used; mono is duplicated. Returns the number of frames read - less
+  // than size at the end of the file.
+  size_t Read(ShortFrame* frames, size_t size);
+  
+  // Same as Read, but when the file already holds 16-bit stereo frames,
+  // *frames points directly into the mapping instead of buffer. The mapping
+  // is private, so the frames can be modified without touching the file.
+  size_t Read(ShortFrame* buffer, size_t size, ShortFrame** frames);
+  
+  // Zero-copy view of the next frames, in the file's own sample format
+  // (frame_size() bytes per frame).
+  size_t View(size_t size, const uint8_t** data);
+  
+  // True when the file holds 16-bit stereo frames.
+  inline bool native() const { return native_; }
+  inline int32_t sample_rate() const { return sample_rate_; }
+  inline int32_t num_channels() const { return num_channels_; }
+  inline int32_t bits_per_sample() const { return bits_per_sample_; }
+  inline size_t frame_size() const { return frame_size_; }
+  inline size_t num_frames() const { return num_frames_; }
+  inline const char* error() const { return error_; }
+  
+ private:
+  bool Fail(const char* error);
+  bool ParseFormat(const uint8_t* fmt, size_t size);
+  
+  int fd_;
+  uint8_t* map_;
+  size_t map_size_;
+  const char* error_;
+  
+  int32_t format_;
+  int32_t num_channels_;
+  int32_t sample_rate_;
+  int32_t bits_per_sample_;
+  size_t frame_size_;
+  size_t num_frames_;
+  bool native_;
+  
+  const uint8_t* data_;
+  size_t position_;
+  
+  DISALLOW_COPY_AND_ASSIGN(WavReader);
+};
+
+class WavWriter {
+ public:
+  WavWriter() : fd_(-1), buffer_(NULL) { }
+  ~WavWriter() { Close(); }
+  
+  bool Open(
+      const char* file_name,
+      int32_t sample_rate,
+      int32_t num_channels = 2);
+  
+  // For stereo files.
+  bool Write(const ShortFrame* frames, size_t size);
+  
+  // Interleaved samples, num_channels per frame.
+  bool WriteSamples(const int16_t* samples, size_t num_frames);
+  
+  // Flushes the buffer and updates the sizes in the header.
+  bool Close();
+  
+ private:
+  size_t FormatHeader(uint8_t* header) const;
+  bool Flush();
+  
+  int fd_;
+  uint8_t* buffer_;
+  size_t buffer_level_;
+  bool error_;
+  
+  int32_t sample_rate_;
+  int32_t num_channels_;
+  size_t num_frames_;
+  
+  DISALLOW_COPY_AND_ASSIGN(WavWriter);
+};
+
+}  // namespace clouds
+
+#endif  // CLOUDS_HOST_WAV_FILE_H_
@@ -27,12 +27,17 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <vector>
 #include <xmmintrin.h>
 
+#include "stmlib/utils/random.h"
+
 #include "clouds/dsp/granular_processor.h"
+#include "clouds/host/pipelined_processor.h"
+#include "clouds/host/wav_file.h"
 #include "clouds/resources.h"
 
 using namespace clouds;
@@ -42,45 +47,18 @@ using namespace stmlib;
 const size_t kSampleRate = 32000;
 const size_t kBlockSize = 32;
 
-void write_wav_header(FILE* fp, int num_samples, int num_channels) {
-  uint32_t l;
-  uint16_t s;
-  
-  fwrite("RIFF", 4, 1, fp);
-  l = 36 + num_samples * 2 * num_channels;
-  fwrite(&l, 4, 1, fp);
-  fwrite("WAVE", 4, 1, fp);
-  
-  fwrite("fmt ", 4, 1, fp);
-  l = 16;
-  fwrite(&l, 4, 1, fp);
-  s = 1;
-  fwrite(&s, 2, 1, fp);
-  s = num_channels;
-  fwrite(&s, 2, 1, fp);
-  l = kSampleRate;
-  fwrite(&l, 4, 1, fp);
-  l = static_cast<uint32_t>(kSampleRate) * 2 * num_channels;
-  fwrite(&l, 4, 1, fp);
-  s = 2 * num_channels;
-  fwrite(&s, 2, 1, fp);
-  s = 16;
-  fwrite(&s, 2, 1, fp);
-  
-  fwrite("data", 4, 1, fp);
-  l = num_samples * 2 * num_channels;
-  fwrite(&l, 4, 1, fp);
-}
-
 void TestDSP() {
   size_t duration = 15;
 
-  FILE* fp_in = fopen("audio_samples/sine.wav", "rb");
-  FILE* fp_out = fopen("clouds.wav", "wb");
+  WavReader reader;
+  if (!reader.Open("audio_samples/sine.wav")) {
+    fprintf(stderr, "audio_samples/sine.wav: %s\n", reader.error());
+    return;
+  }
+  WavWriter writer;
+  writer.Open("clouds.wav", kSampleRate);
 
   size_t remaining_samples = kSampleRate * duration;
-  write_wav_header(fp_out, remaining_samples, 2);
-  fseek(fp_in, 48, SEEK_SET);
   
   uint8_t large_buffer[118784];
   uint8_t small_buffer[65536 - 128]; 
@@ -90,6 +68,7 @@ void TestDSP() {
       &large_buffer[0], sizeof(large_buffer),
       &small_buffer[0],sizeof(small_buffer));
 
+  processor.set_sample_rate(kSampleRate);
   processor.set_num_channels(2);
   processor.set_low_fidelity(false);
   processor.set_playback_mode(PLAYBACK_MODE_GRANULAR);
@@ -137,25 +116,258 @@ void TestDSP() {
       }
       remaining_samples -= kBlockSize;
     } else {
-      if (fread(
-              input,
-              sizeof(ShortFrame),
-              kBlockSize,
-              fp_in) != kBlockSize) {
+      if (reader.Read(input, kBlockSize) != kBlockSize) {
         break;
       }
       remaining_samples -= kBlockSize;
     }
     processor.Process(input, output, kBlockSize);
     processor.Prepare();
-    fwrite(output, sizeof(ShortFrame), kBlockSize, fp_out);
+    writer.Write(output, kBlockSize);
+  }
+  writer.Close();
+}
+
+// Renders input, split into host buffers of the given sizes in turn, with a
+// trigger every trigger_period frames. Returns the latency of the processor.
+size_t Render(
+    bool pipelined,
+    int32_t quality,
+    PlaybackMode mode,
+    const Parameters& parameters,
+    size_t trigger_period,
+    const size_t* sizes,
+    size_t num_sizes,
+    vector<ShortFrame>* input,
+    vector<ShortFrame>* output) {
+  vector<uint8_t> large_buffer(118784);
+  vector<uint8_t> small_buffer(65536 - 128);
+  GranularProcessor* processor = new GranularProcessor;
+  processor->Init(
+      &large_buffer[0], large_buffer.size(),
+      &small_buffer[0], small_buffer.size());
+  processor->set_sample_rate(kSampleRate);
+  processor->set_quality(quality);
+  processor->set_playback_mode(mode);
+  
+  *processor->mutable_parameters() = parameters;
+  do {
+    processor->Prepare();
+  } while (!processor->ready());
+  
+  PipelinedProcessor* pipeline = NULL;
+  if (pipelined) {
+    pipeline = new PipelinedProcessor;
+    bool started = pipeline->Init(processor);
+    assert(started);
+    (void)started;
+  }
+  
+  output->resize(input->size());
+  size_t next_trigger = trigger_period;
+  for (size_t i = 0, start = 0; start < input->size(); ++i) {
+    size_t size = min(sizes[i % num_sizes], input->size() - start);
+    AutomationEvent trigger = { 0, AUTOMATION_TRIGGER, 1.0f };
+    size_t num_events = 0;
+    if (next_trigger < start + size) {
+      trigger.offset = next_trigger - start;
+      next_trigger += trigger_period;
+      num_events = 1;
+    }
+    if (pipeline) {
+      pipeline->Process(
+          &(*input)[start], &(*output)[start], size,
+          num_events ? &trigger : NULL, num_events);
+      pipeline->Prepare();
+    } else {
+      processor->Process(
+          &(*input)[start], &(*output)[start], size,
+          num_events ? &trigger : NULL, num_events);
+      processor->Prepare();
+    }
+    start += size;
+  }
+  size_t latency = processor->latency();
+  if (pipeline) {
+    latency = pipeline->latency();
+    pipeline->Stop();
+    delete pipeline;
+  }
+  delete processor;
+  return latency;
+}
+
+void MakeTestInput(vector<ShortFrame>* input) {
+  input->resize(kSampleRate * 2);
+  float phase = 0.0f;
+  for (size_t i = 0; i < input->size(); ++i) {
+    phase += 220.0f / kSampleRate;
+    if (phase >= 1.0f) {
+      phase -= 1.0f;
+    }
+    (*input)[i].l = 16384.0f * sinf(phase * M_PI * 2);
+    (*input)[i].r = Random::GetSample() >> 2;
+  }
+}
+
+void SetTestParameters(Parameters* parameters) {
+  *parameters = Parameters();
+  parameters->position = 0.3f;
+  parameters->size = 0.6f;
+  parameters->pitch = 5.0f;
+  parameters->density = 0.8f;
+  parameters->texture = 0.6f;
+  parameters->dry_wet = 1.0f;
+  parameters->stereo_spread = 0.5f;
+  parameters->feedback = 0.3f;
+  parameters->reverb = 0.3f;
+}
+
+// The output must not depend on how the host splits its buffers, as long as
+// they are made of whole engine blocks.
+void TestBlockSizeIndependence() {
+  vector<ShortFrame> input;
+  MakeTestInput(&input);
+  Parameters parameters;
+  SetTestParameters(&parameters);
+  
+  const size_t small_blocks[] = { kBlockSize };
+  const size_t large_blocks[] = { 1024, 32, 96, 4096, 640 };
+  vector<ShortFrame> a;
+  vector<ShortFrame> b;
+  bool success = true;
+  for (int32_t mode = 0; mode < PLAYBACK_MODE_LAST; ++mode) {
+    for (int32_t quality = 0; quality < kNumQualities; ++quality) {
+      size_t latency_a = Render(
+          false, quality, PlaybackMode(mode), parameters, 4001,
+          small_blocks, 1, &input, &a);
+      size_t latency_b = Render(
+          false, quality, PlaybackMode(mode), parameters, 4001,
+          large_blocks, 5, &input, &b);
+      if (latency_a || latency_b ||
+          memcmp(&a[0], &b[0], a.size() * sizeof(ShortFrame))) {
+        fprintf(stderr, "mode %d quality %d: output depends on block size\n",
+            mode, quality);
+        success = false;
+      }
+    }
+  }
+  assert(success);
+}
+
+// Host buffers which are not made of whole engine blocks are queued: the
+// output is the same as with whole blocks, delayed by one block.
+void TestPartialBlocks() {
+  vector<ShortFrame> input;
+  MakeTestInput(&input);
+  Parameters parameters;
+  SetTestParameters(&parameters);
+  
+  const size_t small_blocks[] = { kBlockSize };
+  const size_t odd_blocks[] = { 100, 7, 32, 1, 300, 45, 0, 1024 };
+  vector<ShortFrame> a;
+  vector<ShortFrame> b;
+  bool success = true;
+  for (int32_t mode = 0; mode < PLAYBACK_MODE_LAST; ++mode) {
+    for (int32_t quality = 0; quality < kNumQualities; ++quality) {
+      Render(
+          false, quality, PlaybackMode(mode), parameters, 4001,
+          small_blocks, 1, &input, &a);
+      size_t latency = Render(
+          false, quality, PlaybackMode(mode), parameters, 4001,
+          odd_blocks, 8, &input, &b);
+      if (latency != kMaxBlockSize ||
+          memcmp(&a[0], &b[latency],
+              (a.size() - latency) * sizeof(ShortFrame))) {
+        fprintf(stderr, "mode %d quality %d: partial blocks change the "
+            "output\n", mode, quality);
+        success = false;
+      }
+    }
+  }
+  assert(success);
+}
+
+// The feedback path of the pipeline is one block longer. Without feedback,
+// its output is the one of Process(), delayed by its latency.
+void TestPipeline() {
+  vector<ShortFrame> input;
+  MakeTestInput(&input);
+  Parameters parameters;
+  SetTestParameters(&parameters);
+  parameters.feedback = 0.0f;
+  
+  const size_t small_blocks[] = { kBlockSize };
+  const size_t large_blocks[] = { 1024, 32, 96, 4096, 640 };
+  const size_t odd_blocks[] = { 100, 7, 32, 1, 300, 45, 0, 1024 };
+  vector<ShortFrame> a;
+  vector<ShortFrame> b;
+  bool success = true;
+  for (int32_t mode = 0; mode < PLAYBACK_MODE_LAST; ++mode) {
+    for (int32_t quality = 0; quality < kNumQualities; ++quality) {
+      Render(
+          false, quality, PlaybackMode(mode), parameters, 4001,
+          small_blocks, 1, &input, &a);
+      for (int32_t odd = 0; odd < 2; ++odd) {
+        size_t latency = Render(
+            true, quality, PlaybackMode(mode), parameters, 4001,
+            odd ? odd_blocks : large_blocks, odd ? 8 : 5, &input, &b);
+        if (latency != (odd ? 2 : 1) * kMaxBlockSize ||
+            memcmp(&a[0], &b[latency],
+                (a.size() - latency) * sizeof(ShortFrame))) {
+          fprintf(stderr, "mode %d quality %d: the pipeline changes the "
+              "output\n", mode, quality);
+          success = false;
+        }
+      }
+    }
+  }
+  assert(success);
+}
+
+void TestLowFidelityTrigger() {
+  const size_t trigger = kSampleRate / 2 + 20;
+  vector<ShortFrame> input(kSampleRate);
+  for (size_t i = 0; i < input.size(); ++i) {
+    float phase = static_cast<float>(i) * 440.0f / kSampleRate;
+    input[i].l = input[i].r = 16384.0f * sinf(phase * M_PI * 2);
+  }
+  
+  // Wet signal only.
+  Parameters parameters = Parameters();
+  parameters.size = 0.5f;
+  parameters.density = 0.5f;
+  parameters.texture = 0.5f;
+  parameters.dry_wet = 1.0f;
+  
+  const size_t blocks[] = { kBlockSize };
+  vector<ShortFrame> output;
+  bool success = true;
+  for (int32_t quality = 0; quality < kNumQualities; ++quality) {
+    Render(
+        false, quality, PLAYBACK_MODE_GRANULAR, parameters, trigger,
+        blocks, 1, &input, &output);
+    // The first quarter of a second is left for the fade in. The onset is
+    // delayed by the resampling filters in the decimated qualities.
+    size_t onset = kSampleRate / 4;
+    while (onset < output.size() && !output[onset].l && !output[onset].r) {
+      ++onset;
+    }
+    if (onset < trigger || onset >= trigger + kBlockSize) {
+      fprintf(stderr, "quality %d: trigger at frame %zu fired at %zu\n",
+          quality, trigger, onset);
+      success = false;
+    }
   }
-  fclose(fp_out);
-  fclose(fp_in);
+  assert(success);
 }
 
 int main(void) {
   _MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
   TestDSP();
+  TestBlockSizeIndependence();
+  TestPartialBlocks();
+  TestPipeline();
+  TestLowFidelityTrigger();
   // TestGrainSize();
 }
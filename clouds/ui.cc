@@ -62,9 +62,11 @@ void Ui::Init(
   // Sanitize saved settings.
   cv_scaler_->set_blend_parameter(
       static_cast<BlendParameter>(state.blend_parameter & 3));
-  processor_->set_quality(state.quality & 3);
-  processor_->set_playback_mode(
-      static_cast<PlaybackMode>(state.playback_mode % PLAYBACK_MODE_LAST));
+  quality_ = state.quality % kNumQualities;
+  playback_mode_ = state.playback_mode % PLAYBACK_MODE_LAST;
+  inf_reverb_ = false;
+  processor_->set_quality(quality_);
+  processor_->set_playback_mode(static_cast<PlaybackMode>(playback_mode_));
   for (int32_t i = 0; i < BLEND_PARAMETER_LAST; ++i) {
     cv_scaler_->set_blend_value(
         static_cast<BlendParameter>(i),
@@ -81,8 +83,8 @@ void Ui::Init(
 void Ui::SaveState() {
   State* state = settings_->mutable_state();
   state->blend_parameter = cv_scaler_->blend_parameter();
-  state->quality = processor_->quality();
-  state->playback_mode = processor_->playback_mode();
+  state->quality = quality_;
+  state->playback_mode = playback_mode_;
   for (int32_t i = 0; i < BLEND_PARAMETER_LAST; ++i) {
     state->blend_value[i] = static_cast<uint8_t>(
         cv_scaler_->blend_value(static_cast<BlendParameter>(i)) * 255.0f);
@@ -164,7 +166,14 @@ void Ui::PaintLeds() {
       break;
     
     case UI_MODE_QUALITY:
-      leds_.set_status(processor_->quality(), 255, 0);
+      {
+        // The qualities decimating by 4 light the LED of their counterpart
+        // decimating by 2, in yellow.
+        int32_t quality = quality_;
+        bool decimate_4 = quality >= 4;
+        leds_.set_status(decimate_4 ? quality - 2 : quality, 255,
+            decimate_4 ? 255 : 0);
+      }
       break;
       
     case UI_MODE_BLENDING:
@@ -175,14 +184,14 @@ void Ui::PaintLeds() {
       if (blink) {
         for (int i=0; i<4; i++)
           leds_.set_status(i, 0, 0);
-      } else if (processor_->playback_mode() < 4) {      
-        leds_.set_status(processor_->playback_mode(),
+      } else if (playback_mode_ < 4) {      
+        leds_.set_status(playback_mode_,
                          128 + (fade >> 1),
                          255 - (fade >> 1));
       } else {
         for (int i=0; i<4; i++)
           leds_.set_status(i, 128 + (fade >> 1), 255 - (fade >> 1));
-        leds_.set_status(processor_->playback_mode() & 3, 0, 0);
+        leds_.set_status(playback_mode_ & 3, 0, 0);
       }
       
       break;
@@ -271,9 +280,10 @@ void Ui::OnSwitchReleased(const Event& e) {
   switch (e.control_id) {
     case SWITCH_BYPASS:
       if (e.data >= kLongPressDuration) {
-        processor_->set_inf_reverb(true);
+        processor_->Post(COMMAND_SET_INF_REVERB, 1);
+        inf_reverb_ = true;
       } else {
-        processor_->ToggleBypass();
+        processor_->Post(COMMAND_TOGGLE_BYPASS);
       }
       break;
 
@@ -282,10 +292,10 @@ void Ui::OnSwitchReleased(const Event& e) {
       //  processor_->ToggleReverse();
       } else if (e.data >= kLongPressDuration) {
       //  processor_->ToggleFreeze();
-            processor_->ToggleReverse();
+            processor_->Post(COMMAND_TOGGLE_REVERSE);
       } else {
          
-        processor_->ToggleFreeze();
+        processor_->Post(COMMAND_TOGGLE_FREEZE);
       }
       break;
 
@@ -305,13 +315,14 @@ void Ui::OnSwitchReleased(const Event& e) {
         cv_scaler_->set_blend_parameter(static_cast<BlendParameter>(parameter));
         SaveState();
       } else if (mode_ == UI_MODE_QUALITY) {
-        processor_->set_quality((processor_->quality() + 1) & 3);
+        quality_ = (quality_ + 1) % kNumQualities;
+        processor_->Post(COMMAND_SET_QUALITY, quality_);
         SaveState();
       } else if (mode_ == UI_MODE_PLAYBACK_MODE) {
-        uint8_t mode = processor_->playback_mode() == 0 ?
+        playback_mode_ = playback_mode_ == 0 ?
           PLAYBACK_MODE_LAST-1 :
-          processor_->playback_mode() - 1;
-        processor_->set_playback_mode(static_cast<PlaybackMode>(mode));
+          playback_mode_ - 1;
+        processor_->Post(COMMAND_SET_PLAYBACK_MODE, playback_mode_);
         SaveState();
       } else if (mode_ == UI_MODE_SAVE) {
         load_save_location_ = (load_save_location_ + 1) & 3;
@@ -348,8 +359,8 @@ void Ui::OnSwitchReleased(const Event& e) {
       } else if (mode_ == UI_MODE_LOAD) {
         load_save_location_ = (load_save_location_ + 1) & 3;
       } else if (mode_ == UI_MODE_PLAYBACK_MODE) {
-        uint8_t mode = (processor_->playback_mode() + 1) % PLAYBACK_MODE_LAST;
-        processor_->set_playback_mode(static_cast<PlaybackMode>(mode));
+        playback_mode_ = (playback_mode_ + 1) % PLAYBACK_MODE_LAST;
+        processor_->Post(COMMAND_SET_PLAYBACK_MODE, playback_mode_);
         SaveState();
       } else if (e.data >= kLongPressDuration) {
         mode_ = UI_MODE_SAVE;
@@ -401,8 +412,11 @@ void Ui::DoEvents() {
     }
   }
 
-  if (processor_->inf_reverb() && !switches_.pressed(SWITCH_BYPASS)) {
-    processor_->set_inf_reverb(false);
+  // Released once the processor has engaged it - posted only once.
+  if (inf_reverb_ && processor_->inf_reverb() &&
+      !switches_.pressed(SWITCH_BYPASS)) {
+    processor_->Post(COMMAND_SET_INF_REVERB, 0);
+    inf_reverb_ = false;
   }
 }
 
@@ -425,7 +439,7 @@ uint8_t Ui::HandleFactoryTestingRequest(uint8_t command) {
       break;
       
     case FACTORY_TESTING_SET_BYPASS:
-      processor_->set_bypass(argument);
+      processor_->Post(COMMAND_SET_BYPASS, argument);
       break;
       
     case FACTORY_TESTING_CALIBRATE:
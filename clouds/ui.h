@@ -124,6 +124,12 @@ class Ui {
   uint8_t load_save_location_;
   uint16_t ignore_releases_;
   
+  // Settings posted to the processor, which only applies them at its next
+  // block.
+  uint8_t quality_;
+  uint8_t playback_mode_;
+  bool inf_reverb_;
+  
   DISALLOW_COPY_AND_ASSIGN(Ui);
 };
 